@@ -0,0 +1,218 @@
+#include "batch.hpp"
+#include "cache.hpp"
+#include "png.hpp"
+#include "parallel.hpp"
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <cstdio>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static bool ends_with(const std::string &s, const char *ext) {
+  size_t ext_len = strlen(ext);
+  return s.size() >= ext_len && s.compare(s.size() - ext_len, ext_len, ext) == 0;
+}
+
+static bool newer_than(const struct stat &a, const struct stat &b) {
+  if (a.st_mtim.tv_sec != b.st_mtim.tv_sec) return a.st_mtim.tv_sec > b.st_mtim.tv_sec;
+  return a.st_mtim.tv_nsec > b.st_mtim.tv_nsec;
+}
+
+BatchRenderer::BatchRenderer(const char *source, const char *tex_file, const LoadOptions &opts)
+  : opts(opts), frames(opts.turntable ? BATCH_TURNTABLE_FRAMES : 1), source(source), tex_file(tex_file),
+    skipped(0), next_input(0), failed(0), failed_frames(0), loading(0), encode_done(false) {
+}
+
+BatchRenderer::~BatchRenderer() {
+  for (size_t i = 0; i < loaders.size(); i++) if (loaders[i].joinable()) loaders[i].join();
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    encode_done = true;
+  }
+  frame_ready.notify_all();
+  for (size_t i = 0; i < encoders.size(); i++) if (encoders[i].joinable()) encoders[i].join();
+}
+
+std::vector<std::string> BatchRenderer::outputs_for(const std::string &obj_file) const {
+  size_t slash = obj_file.find_last_of('/');
+  std::string dir = slash == std::string::npos ? "" : obj_file.substr(0, slash + 1);
+  std::string stem = obj_file.substr(slash == std::string::npos ? 0 : slash + 1);
+  if (ends_with(stem, ".obj")) stem.resize(stem.size() - 4);
+  if (opts.output != nullptr) dir = std::string(opts.output) + "/";
+
+  std::vector<std::string> outputs;
+  if (frames == 1) {
+    outputs.push_back(dir + stem + ".png");
+  } else {
+    char suffix[16];
+    for (int f = 0; f < frames; f++) {
+      snprintf(suffix, sizeof(suffix), "_%02d.png", f);
+      outputs.push_back(dir + stem + suffix);
+    }
+  }
+  return outputs;
+}
+
+void BatchRenderer::start() {
+  start_time = std::chrono::steady_clock::now();
+
+  std::vector<std::string> found;
+  struct stat st;
+  if (stat(source.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+    DIR *dir = opendir(source.c_str());
+    if (dir == nullptr) {
+      std::cerr << "nao foi possivel abrir o diretorio " << source << ": " << strerror(errno) << std::endl;
+      exit(1);
+    }
+    std::string prefix = ends_with(source, "/") ? source : source + "/";
+    for (struct dirent *e = readdir(dir); e != nullptr; e = readdir(dir)) {
+      if (ends_with(e->d_name, ".obj")) found.push_back(prefix + e->d_name);
+    }
+    closedir(dir);
+    std::sort(found.begin(), found.end());
+  } else {
+    // lista: um .obj por linha, relativo ao diretorio da lista, # comenta
+    std::ifstream in(source.c_str());
+    if (!in) {
+      std::cerr << "nao foi possivel abrir a lista " << source << ": " << strerror(errno) << std::endl;
+      exit(1);
+    }
+    size_t slash = source.find_last_of('/');
+    std::string dir = slash == std::string::npos ? "" : source.substr(0, slash + 1);
+    std::string line;
+    while (std::getline(in, line)) {
+      size_t comment = line.find('#');
+      if (comment != std::string::npos) line.resize(comment);
+      line.erase(line.find_last_not_of(" \t\r") + 1);
+      line.erase(0, line.find_first_not_of(" \t"));
+      if (line.empty()) continue;
+      found.push_back(line[0] == '/' ? line : dir + line);
+    }
+  }
+
+  if (opts.output != nullptr && mkdir(opts.output, 0755) != 0 && errno != EEXIST) {
+    std::cerr << "nao foi possivel criar " << opts.output << ": " << strerror(errno) << std::endl;
+    exit(1);
+  }
+
+  // pula quem ja tem todas as saidas mais novas que o .obj
+  for (size_t i = 0; i < found.size(); i++) {
+    struct stat in_st;
+    if (stat(found[i].c_str(), &in_st) != 0) {
+      std::cerr << "batch: " << found[i] << ": " << strerror(errno) << std::endl;
+      skipped++;
+      continue;
+    }
+    std::vector<std::string> outputs = outputs_for(found[i]);
+    bool fresh = true;
+    for (size_t o = 0; o < outputs.size() && fresh; o++) {
+      struct stat out_st;
+      fresh = stat(outputs[o].c_str(), &out_st) == 0 && newer_than(out_st, in_st);
+    }
+    if (fresh) {
+      skipped++;
+    } else {
+      inputs.push_back(found[i]);
+    }
+  }
+  std::cout << "batch: " << inputs.size() << " malhas (" << skipped << " ja atualizadas), "
+	    << frames << (frames == 1 ? " frame" : " frames") << " cada" << std::endl;
+
+  uint32_t t_loaders = opts.loaders > 0 ? (uint32_t)opts.loaders : std::max<uint32_t>(1, hardware_threads() - opts.contexts);
+  t_loaders = std::max<uint32_t>(1, std::min<uint32_t>(t_loaders, inputs.size()));
+  loading = t_loaders;
+  for (uint32_t i = 0; i < t_loaders; i++) loaders.push_back(std::thread(&BatchRenderer::load_worker, this));
+  for (uint32_t i = 0; i < BATCH_ENCODERS; i++) encoders.push_back(std::thread(&BatchRenderer::encode_worker, this));
+}
+
+void BatchRenderer::load_worker() {
+  // sem --lod/--meshlets por padrao, um frame fixo nao precisa deles
+  while (true) {
+    size_t i = next_input++;
+    if (i >= inputs.size()) break;
+    BatchItem item;
+    if (!ObjLoader::load_file(inputs[i].c_str(), tex_file, opts, &item.mesh)) {
+      std::cerr << "batch: falhou " << inputs[i] << std::endl;
+      failed++;
+      continue;
+    }
+    item.mesh.resolution = glm::vec2(opts.width, opts.height);
+    item.mesh.tex_mode = (TEXTURE_MODE)opts.tex_mode;
+    item.mesh.tex_format = (TEXTURE_FORMAT)opts.tex_format;
+    item.mesh.tex_cache = opts.use_cache;
+    item.mesh.compact = opts.compact;
+    item.mesh.light = true;
+    item.outputs = outputs_for(inputs[i]);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    mesh_free.wait(lock, [this] { return meshes.size() < BATCH_MESH_QUEUE; });
+    meshes.push_back(std::move(item));
+    mesh_ready.notify_one();
+  }
+  std::lock_guard<std::mutex> lock(mutex);
+  loading--;
+  mesh_ready.notify_all();
+}
+
+bool BatchRenderer::pop(BatchItem *item) {
+  std::unique_lock<std::mutex> lock(mutex);
+  mesh_ready.wait(lock, [this] { return !meshes.empty() || loading == 0; });
+  if (meshes.empty()) return false;
+  *item = std::move(meshes.front());
+  meshes.pop_front();
+  mesh_free.notify_one();
+  return true;
+}
+
+void BatchRenderer::encode(const std::string &path, int width, int height, std::vector<uint8_t> *rgba) {
+  BatchFrame frame;
+  frame.path = path;
+  frame.width = width;
+  frame.height = height;
+  frame.rgba.swap(*rgba);
+
+  std::unique_lock<std::mutex> lock(mutex);
+  frame_free.wait(lock, [this] { return pending_frames.size() < BATCH_FRAME_QUEUE; });
+  pending_frames.push_back(std::move(frame));
+  frame_ready.notify_one();
+}
+
+void BatchRenderer::encode_worker() {
+  while (true) {
+    BatchFrame frame;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      frame_ready.wait(lock, [this] { return !pending_frames.empty() || encode_done; });
+      if (pending_frames.empty()) return;
+      frame = std::move(pending_frames.front());
+      pending_frames.pop_front();
+      frame_free.notify_one();
+    }
+    if (!PngWriter::write(frame.path.c_str(), frame.width, frame.height, frame.rgba.data())) {
+      std::cerr << "batch: falhou " << frame.path << std::endl;
+      failed_frames++;
+    }
+  }
+}
+
+void BatchRenderer::finish() {
+  for (size_t i = 0; i < loaders.size(); i++) loaders[i].join();
+  loaders.clear();
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    encode_done = true;
+  }
+  frame_ready.notify_all();
+  for (size_t i = 0; i < encoders.size(); i++) encoders[i].join();
+  encoders.clear();
+
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+  size_t rendered = inputs.size() - failed;
+  std::cout << "batch: " << rendered << " malhas, " << rendered * frames - failed_frames << " PNGs em " << seconds << " s ("
+	    << (seconds > 0.0 ? rendered / seconds : 0.0) << " malhas/s, " << skipped << " puladas, "
+	    << failed << " malhas e " << failed_frames << " PNGs com erro)" << std::endl;
+}
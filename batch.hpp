@@ -0,0 +1,78 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "mesh.hpp"
+#include "obj.hpp"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <atomic>
+#include <chrono>
+#include <string>
+
+#define BATCH_TURNTABLE_FRAMES 36 // uma volta em passos de 10 graus
+#define BATCH_MESH_QUEUE 8        // malhas carregadas esperando um contexto GL
+#define BATCH_FRAME_QUEUE 64      // frames lidos esperando o encode
+#define BATCH_ENCODERS 2
+
+// um .obj carregado e os PNGs que ele gera (um, ou um por passo da volta)
+typedef struct {
+  MeshSettings mesh;
+  std::vector<std::string> outputs;
+} BatchItem;
+
+typedef struct {
+  std::string path;
+  int width;
+  int height;
+  std::vector<uint8_t> rgba;
+} BatchFrame;
+
+// --batch: threads de parse enchem uma fila de malhas, poucos contextos GL
+// desenham e threads de encode gravam os PNGs sem segurar o render
+class BatchRenderer
+{
+public:
+  BatchRenderer(const char *source, const char *tex_file, const LoadOptions &opts);
+  ~BatchRenderer();
+  // lista os .obj (diretorio ou arquivo com um caminho por linha), pula os
+  // que ja tem saida mais nova que a entrada e dispara o parse e o encode
+  void start();
+  // thread de render: bloqueia ate a proxima malha, false quando acabaram
+  bool pop(BatchItem *item);
+  // copia o frame para a fila de encode, bloqueia se ela encheu
+  void encode(const std::string &path, int width, int height, std::vector<uint8_t> *rgba);
+  // espera os PNGs e imprime o throughput
+  void finish();
+
+  LoadOptions opts;
+  int frames;   // 1 no thumbnail, BATCH_TURNTABLE_FRAMES no --turntable
+
+private:
+  void load_worker();
+  void encode_worker();
+  std::vector<std::string> outputs_for(const std::string &obj_file) const;
+
+  std::string source;
+  const char *tex_file;
+  std::vector<std::string> inputs;
+  size_t skipped;
+  std::atomic<size_t> next_input;
+  std::atomic<size_t> failed;        // .obj que nao carregaram, pulados
+  std::atomic<size_t> failed_frames; // PNGs que nao foram gravados
+  std::atomic<uint32_t> loading; // threads de parse ainda rodando
+  std::vector<std::thread> loaders;
+  std::vector<std::thread> encoders;
+  std::mutex mutex;
+  std::condition_variable mesh_ready;
+  std::condition_variable mesh_free;
+  std::condition_variable frame_ready;
+  std::condition_variable frame_free;
+  std::deque<BatchItem> meshes;
+  std::deque<BatchFrame> pending_frames;
+  bool encode_done;
+  std::chrono::steady_clock::time_point start_time;
+};
+
+#endif /* BATCH_H */
@@ -0,0 +1,399 @@
+#include "bcn.hpp"
+#include "mesh.hpp"
+#include "parallel.hpp"
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static const int bc7_weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+// media e eixo principal (iteracao de potencia na covariancia) de n pontos em dims canais
+static void principal_axis(const float (*px)[4], int n, int dims, float mean[4], float axis[4]) {
+  for (int c = 0; c < 4; c++) mean[c] = axis[c] = 0.0f;
+  for (int i = 0; i < n; i++)
+    for (int c = 0; c < dims; c++) mean[c] += px[i][c];
+  for (int c = 0; c < dims; c++) mean[c] /= n;
+
+  float cov[4][4] = {};
+  for (int i = 0; i < n; i++) {
+    for (int a = 0; a < dims; a++) {
+      for (int b = 0; b < dims; b++) cov[a][b] += (px[i][a] - mean[a]) * (px[i][b] - mean[b]);
+    }
+  }
+  // comeca pela linha de maior variancia, converge em poucas iteracoes
+  int row = 0;
+  for (int c = 1; c < dims; c++) if (cov[c][c] > cov[row][row]) row = c;
+  for (int c = 0; c < dims; c++) axis[c] = cov[row][c];
+  for (int it = 0; it < 8; it++) {
+    float next[4] = {};
+    for (int a = 0; a < dims; a++)
+      for (int b = 0; b < dims; b++) next[a] += cov[a][b] * axis[b];
+    float len = 0.0f;
+    for (int c = 0; c < dims; c++) len += next[c] * next[c];
+    if (len <= 1e-12f) break;
+    len = sqrtf(len);
+    for (int c = 0; c < dims; c++) axis[c] = next[c] / len;
+  }
+}
+
+// extremos dos pontos projetados no eixo
+static void axis_endpoints(const float (*px)[4], int n, int dims, const float mean[4], const float axis[4],
+			   float e0[4], float e1[4]) {
+  float tmin = 0.0f, tmax = 0.0f;
+  for (int i = 0; i < n; i++) {
+    float t = 0.0f;
+    for (int c = 0; c < dims; c++) t += (px[i][c] - mean[c]) * axis[c];
+    tmin = std::min(tmin, t);
+    tmax = std::max(tmax, t);
+  }
+  for (int c = 0; c < dims; c++) {
+    e0[c] = std::min(255.0f, std::max(0.0f, mean[c] + axis[c] * tmin));
+    e1[c] = std::min(255.0f, std::max(0.0f, mean[c] + axis[c] * tmax));
+  }
+}
+
+// minimos quadrados de x ~ (1 - t) e0 + t e1 com os pesos t ja escolhidos; false se degenerado
+static bool least_squares(const float (*px)[4], const float *t, int n, int dims, float e0[4], float e1[4]) {
+  float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+  float ax[4] = {}, bx[4] = {};
+  for (int i = 0; i < n; i++) {
+    float a = 1.0f - t[i], b = t[i];
+    aa += a * a;
+    ab += a * b;
+    bb += b * b;
+    for (int c = 0; c < dims; c++) {
+      ax[c] += a * px[i][c];
+      bx[c] += b * px[i][c];
+    }
+  }
+  float det = aa * bb - ab * ab;
+  if (fabsf(det) < 1e-6f) return false;
+  for (int c = 0; c < dims; c++) {
+    e0[c] = std::min(255.0f, std::max(0.0f, (bb * ax[c] - ab * bx[c]) / det));
+    e1[c] = std::min(255.0f, std::max(0.0f, (aa * bx[c] - ab * ax[c]) / det));
+  }
+  return true;
+}
+
+static uint16_t pack565(const float c[3]) {
+  int r = (int)lrintf(c[0] * 31.0f / 255.0f);
+  int g = (int)lrintf(c[1] * 63.0f / 255.0f);
+  int b = (int)lrintf(c[2] * 31.0f / 255.0f);
+  return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+static void unpack565(uint16_t v, int c[3]) {
+  int r = v >> 11, g = (v >> 5) & 63, b = v & 31;
+  c[0] = (r << 3) | (r >> 2);
+  c[1] = (g << 2) | (g >> 4);
+  c[2] = (b << 3) | (b >> 2);
+}
+
+// paleta como o decodificador monta; three: modo de 3 cores (c0 <= c1), indice 3 transparente
+static void bc1_palette(uint16_t c0, uint16_t c1, bool three, int palette[4][3]) {
+  unpack565(c0, palette[0]);
+  unpack565(c1, palette[1]);
+  for (int c = 0; c < 3; c++) {
+    if (three) {
+      palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+      palette[3][c] = 0;
+    } else {
+      palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+      palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+  }
+}
+
+// indice mais proximo de cada texel; retorna o erro quadratico total
+static int bc1_indices(const uint8_t block[64], const bool *transparent, uint16_t c0, uint16_t c1, bool three,
+		       uint8_t indices[16]) {
+  int palette[4][3];
+  bc1_palette(c0, c1, three, palette);
+  int total = 0;
+  for (int i = 0; i < 16; i++) {
+    if (three && transparent[i]) {
+      indices[i] = 3;
+      continue;
+    }
+    int best = 0, best_err = 1 << 30;
+    for (int k = 0; k < (three ? 3 : 4); k++) {
+      int err = 0;
+      for (int c = 0; c < 3; c++) {
+	int d = block[4 * i + c] - palette[k][c];
+	err += d * d;
+      }
+      if (err < best_err) {
+	best_err = err;
+	best = k;
+      }
+    }
+    indices[i] = (uint8_t)best;
+    total += best_err;
+  }
+  return total;
+}
+
+static void write_le16(uint8_t *out, uint16_t v) {
+  out[0] = (uint8_t)v;
+  out[1] = (uint8_t)(v >> 8);
+}
+
+void BlockEncoder::bc1(const uint8_t block[64], bool alpha, uint8_t out[8]) {
+  // com alfa, texels abaixo de 128 viram o indice transparente do modo de 3 cores
+  bool transparent[16];
+  bool three = false;
+  float px[16][4];
+  int n = 0;
+  for (int i = 0; i < 16; i++) {
+    transparent[i] = alpha && block[4 * i + 3] < 128;
+    three = three || transparent[i];
+    if (transparent[i]) continue;
+    for (int c = 0; c < 3; c++) px[n][c] = block[4 * i + c];
+    n++;
+  }
+  if (n == 0) {
+    // todo transparente: c0 == c1 e todos os indices em 3
+    memset(out, 0, 4);
+    memset(out + 4, 0xFF, 4);
+    return;
+  }
+
+  float mean[4], axis[4], e0[4], e1[4];
+  principal_axis(px, n, 3, mean, axis);
+  axis_endpoints(px, n, 3, mean, axis, e0, e1);
+  uint16_t c0 = pack565(e0), c1 = pack565(e1);
+  uint8_t indices[16];
+  int err = bc1_indices(block, transparent, c0, c1, three, indices);
+
+  // refinamento: extremos pelos pesos de cada indice
+  const float weights4[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+  const float weights3[4] = { 0.0f, 1.0f, 0.5f, 0.0f };
+  float t[16];
+  for (int i = 0, k = 0; i < 16; i++) {
+    if (!transparent[i]) t[k++] = three ? weights3[indices[i]] : weights4[indices[i]];
+  }
+  if (least_squares(px, t, n, 3, e0, e1)) {
+    uint16_t r0 = pack565(e0), r1 = pack565(e1);
+    uint8_t refined[16];
+    int refined_err = bc1_indices(block, transparent, r0, r1, three, refined);
+    if (refined_err < err) {
+      c0 = r0;
+      c1 = r1;
+      memcpy(indices, refined, 16);
+    }
+  }
+
+  // a ordem de c0 e c1 escolhe o modo: 4 cores com c0 > c1, 3 cores com c0 <= c1
+  if (three ? c0 > c1 : c0 < c1) {
+    std::swap(c0, c1);
+    for (int i = 0; i < 16; i++) {
+      if (indices[i] < 2) indices[i] ^= 1;
+      else if (!three) indices[i] ^= 1; // 2 <-> 3
+    }
+  } else if (!three && c0 == c1) {
+    memset(indices, 0, 16);
+  }
+
+  uint32_t bits = 0;
+  for (int i = 0; i < 16; i++) bits |= (uint32_t)indices[i] << (2 * i);
+  write_le16(out, c0);
+  write_le16(out + 2, c1);
+  for (int b = 0; b < 4; b++) out[4 + b] = (uint8_t)(bits >> (8 * b));
+}
+
+void BlockEncoder::bc3(const uint8_t block[64], uint8_t out[16]) {
+  // alfa: modo de 8 valores (a0 > a1) entre o maximo e o minimo do bloco
+  int a0 = 0, a1 = 255;
+  for (int i = 0; i < 16; i++) {
+    a0 = std::max(a0, (int)block[4 * i + 3]);
+    a1 = std::min(a1, (int)block[4 * i + 3]);
+  }
+  uint64_t bits = 0;
+  if (a0 > a1) {
+    int palette[8] = { a0, a1 };
+    for (int k = 2; k < 8; k++) palette[k] = ((8 - k) * a0 + (k - 1) * a1) / 7;
+    for (int i = 0; i < 16; i++) {
+      int a = block[4 * i + 3], best = 0;
+      for (int k = 1; k < 8; k++) {
+	if (abs(a - palette[k]) < abs(a - palette[best])) best = k;
+      }
+      bits |= (uint64_t)best << (3 * i);
+    }
+  }
+  out[0] = (uint8_t)a0;
+  out[1] = (uint8_t)a1;
+  for (int b = 0; b < 6; b++) out[2 + b] = (uint8_t)(bits >> (8 * b));
+  // cor: o bloco de cor do BC3 e sempre lido no modo de 4 cores
+  BlockEncoder::bc1(block, false, out + 8);
+}
+
+// extremos de 7 bits + p-bit: v = q << 1 | p
+static void bc7_quantize(const float e[4], int p, int q[4]) {
+  for (int c = 0; c < 4; c++) q[c] = std::min(127, std::max(0, (int)lrintf((e[c] - p) / 2.0f)));
+}
+
+static int bc7_indices(const uint8_t block[64], const int q0[4], int p0, const int q1[4], int p1, uint8_t indices[16]) {
+  int palette[16][4];
+  for (int c = 0; c < 4; c++) {
+    int v0 = q0[c] << 1 | p0, v1 = q1[c] << 1 | p1;
+    for (int k = 0; k < 16; k++) palette[k][c] = ((64 - bc7_weights[k]) * v0 + bc7_weights[k] * v1 + 32) >> 6;
+  }
+  int total = 0;
+#ifdef __SSE2__
+  // duas entradas da paleta por registro (RGBA em 16 bits), o madd soma os quadrados aos pares
+  __m128i pal[8];
+  for (int k = 0; k < 8; k++) {
+    const int *a = palette[2 * k], *b = palette[2 * k + 1];
+    pal[k] = _mm_setr_epi16(a[0], a[1], a[2], a[3], b[0], b[1], b[2], b[3]);
+  }
+  for (int i = 0; i < 16; i++) {
+    const uint8_t *t = &block[4 * i];
+    __m128i texel = _mm_setr_epi16(t[0], t[1], t[2], t[3], t[0], t[1], t[2], t[3]);
+    int best = 0, best_err = 1 << 30;
+    for (int k = 0; k < 8; k++) {
+      __m128i d = _mm_sub_epi16(texel, pal[k]);
+      __m128i sq = _mm_madd_epi16(d, d);
+      sq = _mm_add_epi32(sq, _mm_shuffle_epi32(sq, _MM_SHUFFLE(2, 3, 0, 1)));
+      int err[4];
+      _mm_storeu_si128((__m128i *)err, sq);
+      if (err[0] < best_err) {
+	best_err = err[0];
+	best = 2 * k;
+      }
+      if (err[2] < best_err) {
+	best_err = err[2];
+	best = 2 * k + 1;
+      }
+    }
+    indices[i] = (uint8_t)best;
+    total += best_err;
+  }
+#else
+  for (int i = 0; i < 16; i++) {
+    int best = 0, best_err = 1 << 30;
+    for (int k = 0; k < 16; k++) {
+      int err = 0;
+      for (int c = 0; c < 4; c++) {
+	int d = block[4 * i + c] - palette[k][c];
+	err += d * d;
+      }
+      if (err < best_err) {
+	best_err = err;
+	best = k;
+      }
+    }
+    indices[i] = (uint8_t)best;
+    total += best_err;
+  }
+#endif
+  return total;
+}
+
+typedef struct {
+  int q0[4], q1[4];
+  int p0, p1;
+  uint8_t indices[16];
+  int err;
+} Bc7Fit;
+
+// melhor das 4 combinacoes de p-bits para os extremos e0 e e1
+static void bc7_fit(const uint8_t block[64], const float e0[4], const float e1[4], Bc7Fit *best) {
+  for (int p = 0; p < 4; p++) {
+    Bc7Fit fit;
+    fit.p0 = p & 1;
+    fit.p1 = p >> 1;
+    bc7_quantize(e0, fit.p0, fit.q0);
+    bc7_quantize(e1, fit.p1, fit.q1);
+    fit.err = bc7_indices(block, fit.q0, fit.p0, fit.q1, fit.p1, fit.indices);
+    if (fit.err < best->err) *best = fit;
+  }
+}
+
+// grava count bits de value a partir de *pos, LSB primeiro
+static void put_bits(uint8_t out[16], int *pos, uint32_t value, int count) {
+  for (int b = 0; b < count; b++, (*pos)++) {
+    if (value >> b & 1) out[*pos >> 3] |= (uint8_t)(1 << (*pos & 7));
+  }
+}
+
+void BlockEncoder::bc7(const uint8_t block[64], uint8_t out[16]) {
+  float px[16][4];
+  for (int i = 0; i < 16; i++)
+    for (int c = 0; c < 4; c++) px[i][c] = block[4 * i + c];
+
+  float mean[4], axis[4], e0[4], e1[4];
+  principal_axis(px, 16, 4, mean, axis);
+  axis_endpoints(px, 16, 4, mean, axis, e0, e1);
+  Bc7Fit fit;
+  fit.err = 1 << 30;
+  bc7_fit(block, e0, e1, &fit);
+
+  float t[16];
+  for (int i = 0; i < 16; i++) t[i] = bc7_weights[fit.indices[i]] / 64.0f;
+  if (least_squares(px, t, 16, 4, e0, e1)) bc7_fit(block, e0, e1, &fit);
+
+  // o indice do texel 0 (ancora) tem so 3 bits: o bit alto tem que ser 0
+  if (fit.indices[0] & 8) {
+    for (int c = 0; c < 4; c++) std::swap(fit.q0[c], fit.q1[c]);
+    std::swap(fit.p0, fit.p1);
+    for (int i = 0; i < 16; i++) fit.indices[i] = 15 - fit.indices[i];
+  }
+
+  memset(out, 0, 16);
+  int pos = 0;
+  put_bits(out, &pos, 1 << 6, 7); // modo 6
+  for (int c = 0; c < 4; c++) {
+    put_bits(out, &pos, fit.q0[c], 7);
+    put_bits(out, &pos, fit.q1[c], 7);
+  }
+  put_bits(out, &pos, fit.p0, 1);
+  put_bits(out, &pos, fit.p1, 1);
+  put_bits(out, &pos, fit.indices[0], 3);
+  for (int i = 1; i < 16; i++) put_bits(out, &pos, fit.indices[i], 4);
+}
+
+size_t BlockEncoder::block_bytes(int format) {
+  return format == TEX_FORMAT_BC1 ? 8 : 16;
+}
+
+size_t BlockEncoder::level_size(int format, int width, int height) {
+  size_t bw = (width + BC_BLOCK_DIM - 1) / BC_BLOCK_DIM;
+  size_t bh = (height + BC_BLOCK_DIM - 1) / BC_BLOCK_DIM;
+  return bw * bh * BlockEncoder::block_bytes(format);
+}
+
+void BlockEncoder::encode(int format, const uint8_t *rgba, int width, int height, uint8_t *out) {
+  int bw = (width + BC_BLOCK_DIM - 1) / BC_BLOCK_DIM;
+  int bh = (height + BC_BLOCK_DIM - 1) / BC_BLOCK_DIM;
+  size_t bytes = BlockEncoder::block_bytes(format);
+
+  // o BC1 so usa o modo de 3 cores se a textura tem algum texel transparente
+  bool alpha = false;
+  if (format == TEX_FORMAT_BC1) {
+    for (size_t i = 0; i < (size_t)width * height && !alpha; i++) alpha = rgba[4 * i + 3] < 128;
+  }
+
+  parallel_for(bh, 4, [&](size_t begin, size_t end, uint32_t) {
+    uint8_t block[64];
+    for (size_t by = begin; by < end; by++) {
+      for (int bx = 0; bx < bw; bx++) {
+	// blocos da borda repetem a ultima linha/coluna
+	for (int y = 0; y < BC_BLOCK_DIM; y++) {
+	  int sy = std::min((int)by * BC_BLOCK_DIM + y, height - 1);
+	  for (int x = 0; x < BC_BLOCK_DIM; x++) {
+	    int sx = std::min(bx * BC_BLOCK_DIM + x, width - 1);
+	    memcpy(&block[4 * (y * BC_BLOCK_DIM + x)], &rgba[4 * ((size_t)sy * width + sx)], 4);
+	  }
+	}
+	uint8_t *dst = out + (by * bw + bx) * bytes;
+	if (format == TEX_FORMAT_BC1) BlockEncoder::bc1(block, alpha, dst);
+	else if (format == TEX_FORMAT_BC3) BlockEncoder::bc3(block, dst);
+	else BlockEncoder::bc7(block, dst);
+      }
+    }
+  });
+}
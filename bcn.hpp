@@ -0,0 +1,28 @@
+#ifndef BCN_H
+#define BCN_H
+
+#include <cstdint>
+#include <cstddef>
+
+#define BC_BLOCK_DIM 4
+
+// compressao em blocos 4x4 na CPU: BC1 (8 bytes, RGB + alfa de 1 bit), BC3
+// (16 bytes, BC1 + alfa de 8 bits) e BC7 (16 bytes, so o modo 6: um subconjunto,
+// RGBA de 7 bits + p-bit e indices de 4 bits). Eixo principal das cores para os
+// extremos e uma passada de minimos quadrados sobre os indices
+class BlockEncoder
+{
+public:
+  // format: TEXTURE_FORMAT comprimido
+  static size_t block_bytes(int format);
+  static size_t level_size(int format, int width, int height);
+  // rgba em linhas contiguas; os blocos saem linha a linha, em paralelo por faixas
+  static void encode(int format, const uint8_t *rgba, int width, int height, uint8_t *out);
+
+  // um bloco: 16 texels RGBA, linha a linha
+  static void bc1(const uint8_t block[64], bool alpha, uint8_t out[8]);
+  static void bc3(const uint8_t block[64], uint8_t out[16]);
+  static void bc7(const uint8_t block[64], uint8_t out[16]);
+};
+
+#endif /* BCN_H */
@@ -0,0 +1,294 @@
+// microbenchmark do carregador: cada etapa do load_obj isolada (parse, dedupe,
+// caixa, normais, normalizacao e upload), nas malhas do repositorio e em esferas
+// sinteticas, com aquecimento, repeticoes e mediana/MAD num JSON
+#include "obj.hpp"
+#include "parser.hpp"
+#include "headless.hpp"
+#include "parallel.hpp"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <sys/stat.h>
+#include <GL/glew.h>
+
+#define BENCH_REPS 10
+#define BENCH_WARMUP 2
+#define BENCH_SYNTHETIC "1,10" // milhoes de triangulos das esferas sinteticas
+
+typedef std::chrono::steady_clock bench_clock;
+
+typedef struct {
+  std::string name;
+  std::vector<double> ms;
+} StageTimes;
+
+typedef struct {
+  std::string file;
+  size_t vertices;
+  size_t triangles;
+  std::vector<StageTimes> stages;
+} MeshResult;
+
+static double elapsed_ms(bench_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(bench_clock::now() - start).count();
+}
+
+static double median(std::vector<double> v) {
+  if (v.empty()) return 0.0;
+  std::sort(v.begin(), v.end());
+  size_t n = v.size();
+  return n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2.0;
+}
+
+// desvio absoluto mediano: espalhamento que nao se importa com um outlier
+static double mad(const std::vector<double> &v, double med) {
+  std::vector<double> dev(v.size());
+  for (size_t i = 0; i < v.size(); i++) dev[i] = fabs(v[i] - med);
+  return median(dev);
+}
+
+// fn(): uma repeticao, retorna so o tempo da etapa (a preparacao fica de fora)
+template <typename F>
+static StageTimes run_stage(const std::string &name, int warmup, int reps, F fn) {
+  StageTimes times;
+  times.name = name;
+  for (int i = 0; i < warmup; i++) fn();
+  for (int i = 0; i < reps; i++) times.ms.push_back(fn());
+  double med = median(times.ms);
+  std::cout << "  " << name << ": " << med << " ms (mad " << mad(times.ms, med) << ")" << std::endl;
+  return times;
+}
+
+// esfera UV com ~triangles triangulos, so v e f: as normais saem do generate_normals
+static std::string synthetic_sphere(size_t triangles) {
+  // 2 * segmentos * (aneis - 1) triangulos, com segmentos = 2 * aneis
+  size_t rings = std::max<size_t>(3, (size_t)sqrt(triangles / 4.0) + 1);
+  size_t segments = 2 * rings;
+  std::ostringstream name;
+  name << P_tmpdir << "/mesh2-bench-sphere-" << triangles << ".obj";
+  std::string path = name.str();
+
+  struct stat st;
+  if (stat(path.c_str(), &st) == 0 && st.st_size > 0) return path; // ja gerada
+  std::cout << "gerando " << path << " (" << 2 * segments * (rings - 1) << " triangulos)" << std::endl;
+
+  FILE *f = fopen(path.c_str(), "w");
+  if (f == nullptr) {
+    std::cerr << "nao foi possivel criar " << path << ": " << strerror(errno) << std::endl;
+    exit(1);
+  }
+  fprintf(f, "v 0 1 0\n");
+  for (size_t r = 1; r < rings; r++) {
+    double theta = M_PI * r / rings;
+    for (size_t s = 0; s < segments; s++) {
+      double phi = 2.0 * M_PI * s / segments;
+      fprintf(f, "v %.6f %.6f %.6f\n", sin(theta) * cos(phi), cos(theta), sin(theta) * sin(phi));
+    }
+  }
+  fprintf(f, "v 0 -1 0\n");
+
+  // indices 1-based: polo norte, aneis, polo sul
+  size_t south = 2 + (rings - 1) * segments;
+  for (size_t s = 0; s < segments; s++) {
+    size_t s1 = (s + 1) % segments;
+    fprintf(f, "f 1 %zu %zu\n", 2 + s1, 2 + s);
+  }
+  for (size_t r = 0; r + 2 < rings; r++) {
+    size_t a = 2 + r * segments, b = a + segments;
+    for (size_t s = 0; s < segments; s++) {
+      size_t s1 = (s + 1) % segments;
+      fprintf(f, "f %zu %zu %zu\n", a + s, a + s1, b + s1);
+      fprintf(f, "f %zu %zu %zu\n", a + s, b + s1, b + s);
+    }
+  }
+  size_t last = 2 + (rings - 2) * segments;
+  for (size_t s = 0; s < segments; s++) {
+    size_t s1 = (s + 1) % segments;
+    fprintf(f, "f %zu %zu %zu\n", south, last + s, last + s1);
+  }
+  if (fclose(f) != 0) {
+    std::cerr << "erro ao escrever " << path << ": " << strerror(errno) << std::endl;
+    exit(1);
+  }
+  return path;
+}
+
+static MeshResult bench_mesh(const std::string &path, int warmup, int reps, bool gpu) {
+  std::cout << path << std::endl;
+  MeshResult result;
+  result.file = path;
+  LoadOptions opts = { .tinyobj = false, .convert = false, .use_cache = false, .stream = false, .optimize = false, .overdraw = false, .compact = false, .lod = false, .meshlets = false, .scene = false, .pacing = PACING_VSYNC, .target_fps = 60,
+		       .headless = false, .output = nullptr, .width = WIDTH, .height = HEIGHT,
+		       .tex_mode = NO_TEX, .tex_format = TEX_FORMAT_AUTO, .tex_array = false, .batch = false, .turntable = false, .loaders = 0, .contexts = 1,
+		       .bench = 0.0f, .csv = nullptr };
+
+  ObjData data;
+  result.stages.push_back(run_stage("parse", warmup, reps, [&]() -> double {
+	ObjData fresh;
+	bench_clock::time_point start = bench_clock::now();
+	if (!ObjLoader::parse(path.c_str(), opts, &fresh)) exit(1);
+	double ms = elapsed_ms(start);
+	data = std::move(fresh);
+	return ms;
+      }));
+
+  std::vector<Vertex> verts;
+  std::vector<uint32_t> indices;
+  std::vector<uint8_t> needs_normal;
+  bool has_texcoords = false;
+  size_t missing_normals = 0;
+  result.stages.push_back(run_stage("dedupe", warmup, reps, [&]() -> double {
+	bench_clock::time_point start = bench_clock::now();
+	if (!ObjLoader::dedupe(data, &verts, &indices, &needs_normal, &has_texcoords, &missing_normals)) exit(1);
+	return elapsed_ms(start);
+      }));
+  result.vertices = verts.size();
+  result.triangles = indices.size() / 3;
+  data = ObjData();
+
+  glm::vec3 bbox_min, bbox_max;
+  result.stages.push_back(run_stage("bounds", warmup, reps, [&]() -> double {
+	bench_clock::time_point start = bench_clock::now();
+	ObjLoader::compute_bounds(verts, &bbox_min, &bbox_max);
+	return elapsed_ms(start);
+      }));
+
+  // normais e normalizacao mexem nos vertices: cada repeticao parte de uma copia
+  std::vector<Vertex> work;
+  result.stages.push_back(run_stage("normals", warmup, reps, [&]() -> double {
+	work = verts;
+	bench_clock::time_point start = bench_clock::now();
+	ObjLoader::generate_normals(indices, needs_normal, &work);
+	return elapsed_ms(start);
+      }));
+
+  // a mesma etapa com 1, 2, 4... threads ate o numero de nucleos: mostra a escala
+  std::vector<uint32_t> sweep;
+  for (uint32_t threads = 1; threads < hardware_threads(); threads *= 2) sweep.push_back(threads);
+  if (!sweep.empty()) sweep.push_back(hardware_threads());
+  for (size_t t = 0; t < sweep.size(); t++) {
+    char name[32];
+    snprintf(name, sizeof(name), "normals_%ut", sweep[t]);
+    parallel_limit() = sweep[t];
+    result.stages.push_back(run_stage(name, warmup, reps, [&]() -> double {
+	  work = verts;
+	  bench_clock::time_point start = bench_clock::now();
+	  ObjLoader::generate_normals(indices, needs_normal, &work);
+	  return elapsed_ms(start);
+	}));
+    parallel_limit() = 0;
+  }
+  verts.swap(work);
+
+  glm::vec3 center = (bbox_min + bbox_max) / 2.0f;
+  glm::vec3 tam = bbox_max - bbox_min;
+  float maior_dim = std::max(std::max(tam.x, tam.y), tam.z);
+  float escala = maior_dim > 0.0f ? 1.0f / maior_dim : 1.0f;
+  result.stages.push_back(run_stage("normalize", warmup, reps, [&]() -> double {
+	work = verts;
+	bench_clock::time_point start = bench_clock::now();
+	ObjLoader::normalize(center, escala, &work);
+	return elapsed_ms(start);
+      }));
+  work = std::vector<Vertex>();
+
+  if (gpu) {
+    // VBO e EBO novos a cada vez, glFinish para contar a copia inteira
+    result.stages.push_back(run_stage("upload", warmup, reps, [&]() -> double {
+	  uint32_t buffers[2];
+	  glGenBuffers(2, buffers);
+	  bench_clock::time_point start = bench_clock::now();
+	  glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+	  glBufferData(GL_ARRAY_BUFFER, verts.size() * sizeof(Vertex), verts.data(), GL_STATIC_DRAW);
+	  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[1]);
+	  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint32_t), indices.data(), GL_STATIC_DRAW);
+	  glFinish();
+	  double ms = elapsed_ms(start);
+	  glDeleteBuffers(2, buffers);
+	  return ms;
+	}));
+  }
+  return result;
+}
+
+static void write_json(const char *path, int warmup, int reps, const std::vector<MeshResult> &results) {
+  std::ofstream out(path);
+  if (!out) {
+    std::cerr << "nao foi possivel criar " << path << ": " << strerror(errno) << std::endl;
+    exit(1);
+  }
+  out << "{\n  \"warmup\": " << warmup << ",\n  \"reps\": " << reps << ",\n  \"meshes\": [";
+  for (size_t m = 0; m < results.size(); m++) {
+    const MeshResult &r = results[m];
+    out << (m ? "," : "") << "\n    {\n      \"file\": \"" << r.file << "\",\n      \"vertices\": " << r.vertices
+	<< ",\n      \"triangles\": " << r.triangles << ",\n      \"stages\": {";
+    for (size_t s = 0; s < r.stages.size(); s++) {
+      const StageTimes &t = r.stages[s];
+      double med = median(t.ms);
+      out << (s ? "," : "") << "\n        \"" << t.name << "\": { \"median_ms\": " << med << ", \"mad_ms\": " << mad(t.ms, med)
+	  << ", \"min_ms\": " << *std::min_element(t.ms.begin(), t.ms.end())
+	  << ", \"max_ms\": " << *std::max_element(t.ms.begin(), t.ms.end()) << " }";
+    }
+    out << "\n      }\n    }";
+  }
+  out << "\n  ]\n}\n";
+  std::cout << "json escrito: " << path << std::endl;
+}
+
+int main(int argc, char **argv) {
+  int reps = BENCH_REPS;
+  int warmup = BENCH_WARMUP;
+  const char *synthetic = BENCH_SYNTHETIC;
+  const char *out = "bench.json";
+  bool gpu = true;
+  std::vector<std::string> files;
+
+  for (int i = 1; i < argc; i++) {
+    bool has_value = i + 1 < argc;
+    if (strcmp(argv[i], "--reps") == 0 && has_value) {
+      reps = std::max(1, atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--warmup") == 0 && has_value) {
+      warmup = std::max(0, atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--synthetic") == 0 && has_value) {
+      synthetic = argv[++i];
+    } else if (strcmp(argv[i], "--out") == 0 && has_value) {
+      out = argv[++i];
+    } else if (strcmp(argv[i], "--no-gpu") == 0) {
+      gpu = false;
+    } else if (strcmp(argv[i], "-h") == 0 || strncmp(argv[i], "--", 2) == 0) {
+      std::cout << "uso: mesh2-bench [--reps N] [--warmup N] [--synthetic 1,10,50] [--out bench.json] [--no-gpu] [a.obj ...]" << std::endl;
+      std::cout << "sem .obj usa bunny.obj, sphere1.obj e cylinder.obj; --synthetic \"\" desliga as esferas (milhoes de triangulos)." << std::endl;
+      exit(strcmp(argv[i], "-h") == 0 ? 0 : 1);
+    } else {
+      files.push_back(argv[i]);
+    }
+  }
+  if (files.empty()) {
+    files.push_back("bunny.obj");
+    files.push_back("sphere1.obj");
+    files.push_back("cylinder.obj");
+  }
+  std::stringstream sizes(synthetic);
+  std::string millions;
+  while (std::getline(sizes, millions, ',')) {
+    if (!millions.empty()) files.push_back(synthetic_sphere((size_t)(atof(millions.c_str()) * 1e6)));
+  }
+
+  // o upload precisa de um contexto, o mesmo do --headless
+  HeadlessContext ctx;
+  if (gpu) Headless::create_context(&ctx);
+
+  std::vector<MeshResult> results;
+  for (size_t i = 0; i < files.size(); i++) results.push_back(bench_mesh(files[i], warmup, reps, gpu));
+  write_json(out, warmup, reps, results);
+
+  if (gpu) Headless::destroy_context(&ctx);
+  return 0;
+}
@@ -0,0 +1,152 @@
+#include "cache.hpp"
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+static_assert(sizeof(MeshCacheHeader) == 128, "MeshCacheHeader deve ter 128 bytes");
+
+uint64_t MeshCache::path_hash(const char *file) {
+  char resolved[PATH_MAX];
+  const char *p = realpath(file, resolved) ? resolved : file;
+  uint64_t h = 0xcbf29ce484222325ull;
+  for (; *p; p++) {
+    h ^= (uint8_t)*p;
+    h *= 0x100000001b3ull;
+  }
+  return h;
+}
+
+static bool source_key(const char *obj_file, MeshCacheHeader *header) {
+  struct stat st;
+  if (stat(obj_file, &st) != 0) return false;
+  header->path_hash = MeshCache::path_hash(obj_file);
+  header->src_size = (uint64_t)st.st_size;
+  header->src_mtime_sec = (int64_t)st.st_mtim.tv_sec;
+  header->src_mtime_nsec = (int64_t)st.st_mtim.tv_nsec;
+  return true;
+}
+
+std::string MeshCache::cache_path(const char *obj_file) {
+  return std::string(obj_file) + MESH_CACHE_EXT;
+}
+
+bool MeshCache::write(const char *obj_file, const MeshSettings *mesh_set, uint32_t build) {
+  MeshCacheHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = MESH_CACHE_MAGIC;
+  header.version = MESH_CACHE_VERSION;
+  header.vertex_size = sizeof(Vertex);
+  header.flags = (mesh_set->has_texcoords ? MESH_CACHE_TEXCOORDS : 0) | (build & MESH_CACHE_BUILD_FLAGS);
+  header.t_verts = mesh_set->t_verts;
+  header.t_index = mesh_set->t_index;
+  header.t_lods = (uint32_t)mesh_set->lods.size();
+  header.t_meshlets = (uint32_t)mesh_set->meshlets.size();
+  header.escala = mesh_set->escala;
+  for (int i = 0; i < 3; i++) {
+    header.center[i] = mesh_set->center[i];
+    header.bbox_min[i] = mesh_set->bbox_min[i];
+    header.bbox_max[i] = mesh_set->bbox_max[i];
+  }
+  if (!source_key(obj_file, &header)) {
+    std::cerr << "cache: nao foi possivel ler " << obj_file << ": " << strerror(errno) << std::endl;
+    return false;
+  }
+
+  // escreve num temporario e renomeia, quem estiver lendo nunca ve um cache pela metade
+  std::string path = cache_path(obj_file);
+  std::string tmp_path = path + ".tmp";
+  FILE *f = fopen(tmp_path.c_str(), "wb");
+  if (f == nullptr) {
+    std::cerr << "cache: nao foi possivel criar " << tmp_path << ": " << strerror(errno) << std::endl;
+    return false;
+  }
+  bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+  if (ok && header.t_verts) ok = fwrite(mesh_vertex_data(mesh_set), sizeof(Vertex), header.t_verts, f) == header.t_verts;
+  if (ok && header.t_index) ok = fwrite(mesh_index_data(mesh_set), sizeof(uint32_t), header.t_index, f) == header.t_index;
+  if (ok && header.t_lods) ok = fwrite(mesh_set->lods.data(), sizeof(MeshLod), header.t_lods, f) == header.t_lods;
+  if (ok && header.t_meshlets) ok = fwrite(mesh_set->meshlets.data(), sizeof(Meshlet), header.t_meshlets, f) == header.t_meshlets;
+  ok = (fclose(f) == 0) && ok;
+  if (!ok || rename(tmp_path.c_str(), path.c_str()) != 0) {
+    std::cerr << "cache: erro escrevendo " << path << ": " << strerror(errno) << std::endl;
+    remove(tmp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool MeshCache::map(const char *obj_file, MeshSettings *mesh_set, uint32_t build) {
+  std::string path = cache_path(obj_file);
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) return false;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(MeshCacheHeader)) {
+    close(fd);
+    return false;
+  }
+
+  void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) return false;
+
+  const MeshCacheHeader *header = (const MeshCacheHeader *)addr;
+  MeshCacheHeader key;
+  bool valid = header->magic == MESH_CACHE_MAGIC
+    && header->version == MESH_CACHE_VERSION
+    && header->vertex_size == sizeof(Vertex)
+    && source_key(obj_file, &key)
+    && key.path_hash == header->path_hash
+    && key.src_size == header->src_size
+    && key.src_mtime_sec == header->src_mtime_sec
+    && key.src_mtime_nsec == header->src_mtime_nsec
+    && (uint64_t)st.st_size == sizeof(MeshCacheHeader) + header->t_verts * sizeof(Vertex) + header->t_index * sizeof(uint32_t)
+       + header->t_lods * sizeof(MeshLod) + header->t_meshlets * sizeof(Meshlet);
+  if (!valid) {
+    std::cout << "cache: " << path << " desatualizado, ignorando." << std::endl;
+    munmap(addr, st.st_size);
+    return false;
+  }
+  if ((header->flags & MESH_CACHE_BUILD_FLAGS) != (build & MESH_CACHE_BUILD_FLAGS)) {
+    // ex.: cache sem LODs e --lod na linha de comando; o parse refaz tudo
+    std::cout << "cache: " << path << " feito com outras opcoes, ignorando (refaca com --convert)." << std::endl;
+    munmap(addr, st.st_size);
+    return false;
+  }
+
+  // as paginas vao direto para o glBufferData, pede para o kernel ler adiantado
+  madvise(addr, st.st_size, MADV_WILLNEED);
+
+  const uint8_t *base = (const uint8_t *)addr + sizeof(MeshCacheHeader);
+  mesh_set->mapped.addr = addr;
+  mesh_set->mapped.size = st.st_size;
+  mesh_set->mapped.vertices = (const Vertex *)base;
+  mesh_set->mapped.indices = (const uint32_t *)(base + header->t_verts * sizeof(Vertex));
+  mesh_set->t_verts = header->t_verts;
+  mesh_set->t_index = header->t_index;
+  const MeshLod *lods = (const MeshLod *)(base + header->t_verts * sizeof(Vertex) + header->t_index * sizeof(uint32_t));
+  mesh_set->lods.assign(lods, lods + header->t_lods);
+  const Meshlet *meshlets = (const Meshlet *)(lods + header->t_lods);
+  mesh_set->meshlets.assign(meshlets, meshlets + header->t_meshlets);
+  mesh_set->has_texcoords = (header->flags & MESH_CACHE_TEXCOORDS) != 0;
+  mesh_set->center = glm::vec3(header->center[0], header->center[1], header->center[2]);
+  mesh_set->escala = header->escala;
+  mesh_set->bbox_min = glm::vec3(header->bbox_min[0], header->bbox_min[1], header->bbox_min[2]);
+  mesh_set->bbox_max = glm::vec3(header->bbox_max[0], header->bbox_max[1], header->bbox_max[2]);
+  return true;
+}
+
+void MeshCache::unmap(MeshSettings *mesh_set) {
+  if (mesh_set->mapped.addr == nullptr) return;
+  munmap(mesh_set->mapped.addr, mesh_set->mapped.size);
+  mesh_set->mapped.addr = nullptr;
+  mesh_set->mapped.size = 0;
+  mesh_set->mapped.vertices = nullptr;
+  mesh_set->mapped.indices = nullptr;
+}
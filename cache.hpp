@@ -0,0 +1,56 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "mesh.hpp"
+#include <string>
+
+#define MESH_CACHE_MAGIC 0x3243324Du // "M2C2"
+#define MESH_CACHE_VERSION 6
+#define MESH_CACHE_EXT ".mesh2cache"
+
+#define MESH_CACHE_TEXCOORDS (1u << 0)
+// opcoes de build que mudam o conteudo: o cache so serve com as mesmas
+#define MESH_CACHE_LOD (1u << 1)
+#define MESH_CACHE_OPTIMIZE (1u << 2)
+#define MESH_CACHE_OVERDRAW (1u << 3)
+#define MESH_CACHE_MESHLETS (1u << 4)
+// o --compact empacota no render_init, nao muda o cache
+#define MESH_CACHE_BUILD_FLAGS (MESH_CACHE_LOD | MESH_CACHE_OPTIMIZE | MESH_CACHE_OVERDRAW | MESH_CACHE_MESHLETS)
+
+// cabecalho do cache, seguido de Vertex[t_verts], uint32_t[t_index], MeshLod[t_lods]
+// e Meshlet[t_meshlets]
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t vertex_size;  // sizeof(Vertex) de quem escreveu
+  uint32_t flags;        // MESH_CACHE_TEXCOORDS e as MESH_CACHE_BUILD_FLAGS
+  uint64_t path_hash;    // FNV-1a do caminho absoluto do .obj
+  uint64_t src_size;
+  int64_t src_mtime_sec;
+  int64_t src_mtime_nsec;
+  uint64_t t_verts;
+  uint64_t t_index;
+  float center[3];
+  float bbox_min[3];
+  float bbox_max[3];
+  uint32_t t_lods;       // 0 sem --lod
+  uint32_t t_meshlets;   // 0 sem --meshlets
+  float escala;          // normalizado = (original - center) * escala
+  uint32_t pad[4];       // completa 128 bytes
+} MeshCacheHeader;
+
+class MeshCache
+{
+public:
+  static std::string cache_path(const char *obj_file);
+  // FNV-1a do caminho absoluto, parte da chave dos caches
+  static uint64_t path_hash(const char *file);
+  // build: MESH_CACHE_BUILD_FLAGS das opcoes usadas no build
+  static bool write(const char *obj_file, const MeshSettings *mesh_set, uint32_t build);
+  // mapeia o cache se a chave (caminho, tamanho, mtime) bate com o .obj e ele
+  // foi feito com as mesmas opcoes de build
+  static bool map(const char *obj_file, MeshSettings *mesh_set, uint32_t build);
+  static void unmap(MeshSettings *mesh_set);
+};
+
+#endif /* CACHE_H */
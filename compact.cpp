@@ -0,0 +1,94 @@
+#include "compact.hpp"
+#include "parallel.hpp"
+#include <cmath>
+#include <cstring>
+
+#define PACK_GRAIN 65536
+
+static_assert(sizeof(CompactVertex) == 16, "CompactVertex deve ter 16 bytes");
+
+static uint16_t quantize_unorm16(float v, float min, float extent) {
+  if (extent <= 0.0f) return 0;
+  float t = (v - min) / extent;
+  t = t < 0.0f ? 0.0f : (t > 1.0f ? 1.0f : t);
+  return (uint16_t)(t * 65535.0f + 0.5f);
+}
+
+static int16_t quantize_snorm16(float v) {
+  v = v < -1.0f ? -1.0f : (v > 1.0f ? 1.0f : v);
+  return (int16_t)roundf(v * 32767.0f);
+}
+
+static uint8_t quantize_unorm8(float v) {
+  v = v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v);
+  return (uint8_t)(v * 255.0f + 0.5f);
+}
+
+void VertexPacker::oct_encode(glm::vec3 n, int16_t out[2]) {
+  float l1 = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+  if (l1 == 0.0f) {
+    out[0] = 0;
+    out[1] = 0;
+    return;
+  }
+  float x = n.x / l1;
+  float y = n.y / l1;
+  if (n.z < 0.0f) {
+    // hemisferio de baixo dobrado para os cantos do quadrado
+    float ox = x;
+    x = (1.0f - fabsf(y)) * (ox >= 0.0f ? 1.0f : -1.0f);
+    y = (1.0f - fabsf(ox)) * (y >= 0.0f ? 1.0f : -1.0f);
+  }
+  out[0] = quantize_snorm16(x);
+  out[1] = quantize_snorm16(y);
+}
+
+uint16_t VertexPacker::float_to_half(float f) {
+  uint32_t x;
+  memcpy(&x, &f, sizeof(x));
+  uint32_t sign = (x >> 16) & 0x8000;
+  uint32_t exp_bits = (x >> 23) & 0xff;
+  uint32_t mant = x & 0x7fffff;
+  if (exp_bits == 0xff) return sign | 0x7c00 | (mant ? 0x200 : 0); // inf/nan
+  int32_t exp = (int32_t)exp_bits - 127 + 15;
+  if (exp >= 31) return sign | 0x7c00;
+  if (exp <= 0) {
+    // subnormal do half
+    if (exp < -10) return sign;
+    mant |= 0x800000;
+    uint32_t shift = (uint32_t)(14 - exp);
+    uint32_t h = mant >> shift;
+    if ((mant >> (shift - 1)) & 1) h++;
+    return sign | h;
+  }
+  uint32_t h = sign | ((uint32_t)exp << 10) | (mant >> 13);
+  if (mant & 0x1000) h++; // o carry sobe para o expoente sozinho
+  return h;
+}
+
+void VertexPacker::pack(const MeshSettings *mesh_set, CompactMesh *out) {
+  const Vertex *verts = mesh_vertex_data(mesh_set);
+  const uint32_t *indices = mesh_index_data(mesh_set);
+  size_t t_verts = mesh_set->t_verts;
+  size_t t_index = mesh_set->t_index;
+  glm::vec3 bmin = mesh_set->bbox_min;
+  glm::vec3 extent = mesh_set->bbox_max - mesh_set->bbox_min;
+
+  out->vertices.resize(t_verts);
+  parallel_for(t_verts, PACK_GRAIN, [&](size_t begin, size_t end, uint32_t) {
+    for (size_t i = begin; i < end; i++) {
+      const Vertex &v = verts[i];
+      CompactVertex &c = out->vertices[i];
+      for (int k = 0; k < 3; k++) c.position[k] = quantize_unorm16(v.position[k], bmin[k], extent[k]);
+      c.pad = 0;
+      oct_encode(v.normal, c.normal);
+      for (int k = 0; k < 4; k++) c.color[k] = quantize_unorm8(v.color[k]);
+    }
+  });
+
+  out->indices.clear();
+  if (t_verts < 65536) {
+    out->indices.resize(t_index);
+    for (size_t i = 0; i < t_index; i++) out->indices[i] = (uint16_t)indices[i];
+  }
+}
@@ -0,0 +1,28 @@
+#ifndef COMPACT_H
+#define COMPACT_H
+
+#include "mesh.hpp"
+
+// 16 bytes contra os 52 do Vertex, decodificado no vertex shader (COMPACT)
+typedef struct {
+  uint16_t position[3]; // unorm16 dentro de bbox_min .. bbox_max
+  uint16_t pad;
+  int16_t normal[2];    // snorm16, normal projetada no octaedro
+  uint8_t color[4];     // unorm8
+} CompactVertex;
+
+typedef struct {
+  std::vector<CompactVertex> vertices;
+  std::vector<uint16_t> indices;   // 16 bits, vazio quando t_verts >= 65536
+} CompactMesh;
+
+class VertexPacker
+{
+public:
+  // quantiza os vertices de mesh_set na caixa normalizada (bbox_min .. bbox_max)
+  static void pack(const MeshSettings *mesh_set, CompactMesh *out);
+  static void oct_encode(glm::vec3 n, int16_t out[2]);
+  static uint16_t float_to_half(float f);
+};
+
+#endif /* COMPACT_H */
@@ -0,0 +1,117 @@
+#include "framebench.hpp"
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cerrno>
+#include <GL/glew.h>
+
+FrameBench::FrameBench(float seconds, const char *csv_path)
+  : seconds(seconds), csv_path(csv_path), t_pending(0), oldest(0) {
+  memset(queries, 0, sizeof(queries));
+}
+
+FrameBench::~FrameBench() {
+  if (queries[0] != 0) glDeleteQueries(BENCH_QUERY_RING, queries);
+}
+
+void FrameBench::start() {
+  glGenQueries(BENCH_QUERY_RING, queries);
+  samples.reserve(4096);
+  start_time = clock::now();
+}
+
+bool FrameBench::done() const {
+  return std::chrono::duration<float>(clock::now() - start_time).count() >= seconds;
+}
+
+glm::vec2 FrameBench::frame_begin(MeshSettings *mesh_set) {
+  // anel cheio: espera a mais antiga, a GPU esta BENCH_QUERY_RING frames atras;
+  // a espera conta no tempo do frame, sem swap (--headless) e ela que segura a CPU
+  frame_start = clock::now();
+  if (t_pending == BENCH_QUERY_RING) collect(true);
+
+  size_t slot = (oldest + t_pending) % BENCH_QUERY_RING;
+  query_frame[slot] = samples.size();
+  t_pending++;
+  samples.push_back((BenchSample){
+      .time_ms = std::chrono::duration<double, std::milli>(frame_start - start_time).count(),
+      .cpu_ms = 0.0f,
+      .gpu_ms = -1.0f,
+    });
+  glBeginQuery(GL_TIME_ELAPSED, queries[slot]);
+
+  // o mesmo caminho do arrasto com o mouse: rotation_calc entre dois pontos
+  // no meio da tela, um giro constante em torno do y
+  glm::vec2 center = glm::vec2(WIDTH / 2.0f, HEIGHT / 2.0f);
+  mesh_set->rotating = true;
+  mesh_set->mouse_pos = center - glm::vec2(BENCH_ORBIT_STEP / 2.0f, 0.0f);
+  return center + glm::vec2(BENCH_ORBIT_STEP / 2.0f, 0.0f);
+}
+
+void FrameBench::frame_end() {
+  glEndQuery(GL_TIME_ELAPSED);
+  // a consulta pode dar flush (no llvmpipe o raster roda nela), entra no frame
+  collect(false);
+  samples.back().cpu_ms = std::chrono::duration<float, std::milli>(clock::now() - frame_start).count();
+}
+
+void FrameBench::collect(bool wait) {
+  while (t_pending > 0) {
+    uint32_t query = queries[oldest];
+    if (!wait) {
+      GLint available = 0;
+      glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+      if (!available) return;
+    }
+    GLuint64 ns = 0;
+    glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+    samples[query_frame[oldest]].gpu_ms = (float)(ns / 1.0e6);
+    oldest = (oldest + 1) % BENCH_QUERY_RING;
+    t_pending--;
+    // com wait so libera um lugar no anel
+    if (wait) return;
+  }
+}
+
+static float percentile(const std::vector<float> &sorted, float p) {
+  if (sorted.empty()) return 0.0f;
+  size_t rank = (size_t)ceilf(p * sorted.size());
+  return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+void FrameBench::finish(MeshSettings *mesh_set) {
+  while (t_pending > 0) collect(true);
+  mesh_set->rotating = false;
+
+  std::vector<float> cpu, gpu;
+  for (size_t i = BENCH_WARMUP_FRAMES; i < samples.size(); i++) {
+    cpu.push_back(samples[i].cpu_ms);
+    gpu.push_back(samples[i].gpu_ms);
+  }
+  std::sort(cpu.begin(), cpu.end());
+  std::sort(gpu.begin(), gpu.end());
+
+  std::cout << "bench: " << mesh_set->obj_file << ", " << samples.size() << " frames em " << seconds << " s ("
+	    << BENCH_WARMUP_FRAMES << " de aquecimento fora)" << std::endl;
+  const char *names[] = { "cpu", "gpu" };
+  const std::vector<float> *series[] = { &cpu, &gpu };
+  for (int s = 0; s < 2; s++) {
+    const std::vector<float> &v = *series[s];
+    std::cout << "  " << names[s] << " ms: p50 " << percentile(v, 0.50f) << "  p95 " << percentile(v, 0.95f)
+	      << "  p99 " << percentile(v, 0.99f) << "  max " << (v.empty() ? 0.0f : v.back()) << std::endl;
+  }
+
+  std::ofstream out(csv_path.c_str());
+  if (!out) {
+    std::cerr << "nao foi possivel criar " << csv_path << ": " << strerror(errno) << std::endl;
+    exit(1);
+  }
+  out << "frame,time_ms,cpu_ms,gpu_ms,warmup\n";
+  for (size_t i = 0; i < samples.size(); i++) {
+    out << i << "," << samples[i].time_ms << "," << samples[i].cpu_ms << "," << samples[i].gpu_ms << ","
+	<< (i < BENCH_WARMUP_FRAMES ? 1 : 0) << "\n";
+  }
+  std::cout << "csv escrito: " << csv_path << std::endl;
+}
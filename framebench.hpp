@@ -0,0 +1,51 @@
+#ifndef FRAMEBENCH_H
+#define FRAMEBENCH_H
+
+#include "mesh.hpp"
+#include <chrono>
+#include <string>
+#include <vector>
+
+#define BENCH_QUERY_RING 8     // queries GL_TIME_ELAPSED em voo antes de esperar pela mais antiga
+#define BENCH_WARMUP_FRAMES 10 // primeiros frames fora dos percentis (shaders, uploads)
+#define BENCH_ORBIT_STEP 16.0f // arrasto do trackball por frame, em pixels
+
+typedef struct {
+  double time_ms; // desde o inicio do --bench
+  float cpu_ms;   // do inicio do frame ate depois do swap, inclui a espera pelo anel
+  float gpu_ms;   // GL_TIME_ELAPSED, -1 ate o resultado chegar
+} BenchSample;
+
+// --bench N: orbita roteirizada pelo trackball durante N segundos, tempo de CPU
+// e de GPU por frame, percentis no fim e um CSV com todas as amostras
+class FrameBench
+{
+public:
+  FrameBench(float seconds, const char *csv_path);
+  ~FrameBench();
+  // cria as queries, precisa do contexto GL atual
+  void start();
+  // arrasto sintetico para o draw (mouse_pos e rotating) e inicio da query
+  glm::vec2 frame_begin(MeshSettings *mesh_set);
+  // fim da query e do tempo de CPU; le so as queries que ja terminaram
+  void frame_end();
+  bool done() const;
+  // espera as queries que faltam, imprime p50/p95/p99/max e grava o CSV
+  void finish(MeshSettings *mesh_set);
+
+private:
+  typedef std::chrono::steady_clock clock;
+  void collect(bool wait);
+
+  float seconds;
+  std::string csv_path;
+  uint32_t queries[BENCH_QUERY_RING];
+  size_t query_frame[BENCH_QUERY_RING]; // amostra de cada query em voo
+  size_t t_pending;
+  size_t oldest;
+  std::vector<BenchSample> samples;
+  clock::time_point start_time;
+  clock::time_point frame_start;
+};
+
+#endif /* FRAMEBENCH_H */
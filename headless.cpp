@@ -0,0 +1,182 @@
+#include "headless.hpp"
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <mutex>
+#include <GL/glew.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+static const char *egl_error() {
+  switch (eglGetError()) {
+  case EGL_SUCCESS: return "EGL_SUCCESS";
+  case EGL_NOT_INITIALIZED: return "EGL_NOT_INITIALIZED";
+  case EGL_BAD_ACCESS: return "EGL_BAD_ACCESS";
+  case EGL_BAD_ALLOC: return "EGL_BAD_ALLOC";
+  case EGL_BAD_ATTRIBUTE: return "EGL_BAD_ATTRIBUTE";
+  case EGL_BAD_CONFIG: return "EGL_BAD_CONFIG";
+  case EGL_BAD_CONTEXT: return "EGL_BAD_CONTEXT";
+  case EGL_BAD_DISPLAY: return "EGL_BAD_DISPLAY";
+  case EGL_BAD_MATCH: return "EGL_BAD_MATCH";
+  case EGL_BAD_PARAMETER: return "EGL_BAD_PARAMETER";
+  default: return "erro EGL";
+  }
+}
+
+// o EGLDisplay e o mesmo para todos os contextos do --contexts N: o
+// eglTerminate so pode rodar quando o ultimo deles for destruido
+static std::mutex display_mutex;
+static uint32_t display_refs = 0;
+
+void Headless::create_context(HeadlessContext *ctx) {
+  // surfaceless primeiro (llvmpipe em container), senao o display padrao
+  EGLDisplay display = EGL_NO_DISPLAY;
+  const char *extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+  PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+    (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+  if (extensions != nullptr && strstr(extensions, "EGL_MESA_platform_surfaceless") != nullptr && get_platform_display != nullptr) {
+    display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+  }
+  if (display == EGL_NO_DISPLAY) display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+  EGLint major, minor;
+  {
+    std::lock_guard<std::mutex> lock(display_mutex);
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+      std::cerr << "nao foi possivel inicializar o EGL: " << egl_error() << std::endl;
+      exit(1);
+    }
+    display_refs++;
+  }
+  if (!eglBindAPI(EGL_OPENGL_API)) {
+    std::cerr << "EGL sem suporte a OpenGL: " << egl_error() << std::endl;
+    exit(1);
+  }
+
+  // sem superficie: o frame vai para o FBO, a config so escolhe o driver
+  const EGLint config_attribs[] = {
+    EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+    EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+    EGL_NONE
+  };
+  EGLConfig config;
+  EGLint t_configs = 0;
+  if (!eglChooseConfig(display, config_attribs, &config, 1, &t_configs) || t_configs == 0) {
+    std::cerr << "nenhuma config EGL com OpenGL: " << egl_error() << std::endl;
+    exit(1);
+  }
+
+  const EGLint context_attribs[] = {
+    EGL_CONTEXT_MAJOR_VERSION, 3,
+    EGL_CONTEXT_MINOR_VERSION, 3,
+    EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+    EGL_NONE
+  };
+  EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, context_attribs);
+  if (context == EGL_NO_CONTEXT) {
+    std::cerr << "nao foi possivel criar o contexto GL 3.3 core: " << egl_error() << std::endl;
+    exit(1);
+  }
+  if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+    std::cerr << "eglMakeCurrent sem superficie falhou: " << egl_error() << std::endl;
+    exit(1);
+  }
+
+  // no core o glewInit precisa do experimental; sem X o GLEW com GLX reclama
+  // da falta de display, mas as funcoes do GL ja foram carregadas
+  glewExperimental = GL_TRUE;
+  GLenum err = glewInit();
+  if (err != GLEW_OK
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+      && err != GLEW_ERROR_NO_GLX_DISPLAY
+#endif
+      ) {
+    std::cerr << "GLEW initialization error: " << glewGetErrorString(err) << std::endl;
+    exit(1);
+  }
+  while (glGetError() != GL_NO_ERROR); // o glewInit deixa GL_INVALID_ENUM no core
+
+  std::cout << "EGL " << major << "." << minor << std::endl;
+  ctx->display = display;
+  ctx->context = context;
+}
+
+void Headless::destroy_context(HeadlessContext *ctx) {
+  eglMakeCurrent(ctx->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+  eglDestroyContext(ctx->display, ctx->context);
+  eglReleaseThread();
+  {
+    std::lock_guard<std::mutex> lock(display_mutex);
+    if (--display_refs == 0) eglTerminate(ctx->display);
+  }
+  ctx->display = nullptr;
+  ctx->context = nullptr;
+}
+
+void Headless::create_target(int width, int height, int samples, RenderTarget *target) {
+  GLint max_samples = 0;
+  glGetIntegerv(GL_MAX_SAMPLES, &max_samples);
+  if (samples > max_samples) samples = max_samples;
+  target->width = width;
+  target->height = height;
+
+  glGenRenderbuffers(1, &target->color);
+  glBindRenderbuffer(GL_RENDERBUFFER, target->color);
+  glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_RGBA8, width, height);
+  glGenRenderbuffers(1, &target->depth);
+  glBindRenderbuffer(GL_RENDERBUFFER, target->depth);
+  glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_DEPTH24_STENCIL8, width, height);
+
+  glGenFramebuffers(1, &target->fbo);
+  glBindFramebuffer(GL_FRAMEBUFFER, target->fbo);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, target->color);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, target->depth);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    std::cerr << "FBO " << width << "x" << height << " incompleto" << std::endl;
+    exit(1);
+  }
+
+  // sem multisample, so para o glReadPixels
+  glGenRenderbuffers(1, &target->resolve_color);
+  glBindRenderbuffer(GL_RENDERBUFFER, target->resolve_color);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+  glGenFramebuffers(1, &target->resolve_fbo);
+  glBindFramebuffer(GL_FRAMEBUFFER, target->resolve_fbo);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, target->resolve_color);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    std::cerr << "FBO de resolve incompleto" << std::endl;
+    exit(1);
+  }
+
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+  glBindFramebuffer(GL_FRAMEBUFFER, target->fbo);
+  glViewport(0, 0, width, height);
+}
+
+void Headless::destroy_target(RenderTarget *target) {
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  glDeleteFramebuffers(1, &target->fbo);
+  glDeleteFramebuffers(1, &target->resolve_fbo);
+  glDeleteRenderbuffers(1, &target->color);
+  glDeleteRenderbuffers(1, &target->depth);
+  glDeleteRenderbuffers(1, &target->resolve_color);
+}
+
+void Headless::read_pixels(const RenderTarget &target, std::vector<uint8_t> *rgba) {
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, target.fbo);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target.resolve_fbo);
+  glBlitFramebuffer(0, 0, target.width, target.height, 0, 0, target.width, target.height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+
+  size_t row = (size_t)target.width * 4;
+  std::vector<uint8_t> pixels(row * target.height);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, target.resolve_fbo);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, target.width, target.height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+  glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+
+  // o GL le de baixo para cima
+  rgba->resize(pixels.size());
+  for (int y = 0; y < target.height; y++) {
+    memcpy(&(*rgba)[y * row], &pixels[(target.height - 1 - y) * row], row);
+  }
+}
@@ -0,0 +1,40 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <cstdint>
+#include <vector>
+
+#define HEADLESS_SAMPLES 4 // MSAA do FBO, a janela pede o mesmo ao GLFW
+
+// contexto EGL sem superficie (EGL_MESA_platform_surfaceless)
+typedef struct {
+  void *display; // EGLDisplay
+  void *context; // EGLContext
+} HeadlessContext;
+
+// FBO multisample onde o frame e desenhado e o resolvido, lido pelo read_pixels
+typedef struct {
+  uint32_t fbo;
+  uint32_t color;
+  uint32_t depth;
+  uint32_t resolve_fbo;
+  uint32_t resolve_color;
+  int width;
+  int height;
+} RenderTarget;
+
+// --headless: GL 3.3 core sem servidor grafico, sem GLFW e sem ImGui
+class Headless
+{
+public:
+  // cria o contexto, deixa atual e inicializa o GLEW; sai com erro se nao der
+  static void create_context(HeadlessContext *ctx);
+  static void destroy_context(HeadlessContext *ctx);
+  // deixa o FBO ligado e o viewport no tamanho dele
+  static void create_target(int width, int height, int samples, RenderTarget *target);
+  static void destroy_target(RenderTarget *target);
+  // resolve o MSAA e le o RGBA8 com a primeira linha em cima
+  static void read_pixels(const RenderTarget &target, std::vector<uint8_t> *rgba);
+};
+
+#endif /* HEADLESS_H */
@@ -0,0 +1,45 @@
+#include "instance.hpp"
+#include <cmath>
+#include <random>
+#include <glm/ext/matrix_transform.hpp> // glm::translate, glm::rotate, glm::scale
+
+static uint32_t grid_side(uint32_t count) {
+  uint32_t side = (uint32_t)ceilf(cbrtf((float)count));
+  while (side * side * side < count) side++;
+  return std::max(side, 1u);
+}
+
+float InstanceLayout::instance_scale(uint32_t count) {
+  if (count <= 1) return 1.0f;
+  return INSTANCE_FILL / (float)grid_side(count);
+}
+
+void InstanceLayout::build(uint32_t count, INSTANCE_LAYOUT layout, std::vector<glm::mat4> *transforms) {
+  transforms->resize(std::max(count, 1u));
+  if (count <= 1) {
+    (*transforms)[0] = glm::mat4(1.0f);
+    return;
+  }
+
+  uint32_t side = grid_side(count);
+  float cell = 1.0f / (float)side;
+  glm::vec3 scale = glm::vec3(InstanceLayout::instance_scale(count));
+  std::mt19937 rng(42);
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+  for (uint32_t i = 0; i < count; i++) {
+    glm::vec3 pos;
+    float angle = 0.0f;
+    if (layout == INSTANCE_GRID) {
+      // x varia mais rapido, a grade e preenchida de baixo para cima
+      pos = glm::vec3(i % side, (i / side) / side, (i / side) % side);
+      pos = (pos + 0.5f) * cell - 0.5f;
+    } else {
+      pos = glm::vec3(unit(rng), unit(rng), unit(rng)) * (1.0f - cell) - 0.5f * (1.0f - cell);
+      angle = unit(rng) * 2.0f * (float)M_PI;
+    }
+    glm::mat4 m = glm::translate(glm::mat4(1.0f), pos);
+    m = glm::rotate(m, angle, glm::vec3(0.0f, 1.0f, 0.0f));
+    (*transforms)[i] = glm::scale(m, scale);
+  }
+}
@@ -0,0 +1,25 @@
+#ifndef INSTANCE_H
+#define INSTANCE_H
+
+#include "mesh.hpp"
+
+#define INSTANCE_MAX 100000  // limite do slider de copias
+#define INSTANCE_FILL 0.8f   // fracao da celula ocupada por cada copia
+
+enum INSTANCE_LAYOUT {
+  INSTANCE_GRID = 0,
+  INSTANCE_RANDOM,
+};
+
+// transformacoes por instancia do modo de estresse: as copias dividem o cubo
+// unitario da malha normalizada, assim o conjunto continua do tamanho da malha
+class InstanceLayout
+{
+public:
+  // escala de cada copia para count instancias (1 com uma so)
+  static float instance_scale(uint32_t count);
+  // grade cubica ou posicoes aleatorias (semente fixa) com rotacao em y
+  static void build(uint32_t count, INSTANCE_LAYOUT layout, std::vector<glm::mat4> *transforms);
+};
+
+#endif /* INSTANCE_H */
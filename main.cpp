@@ -4,6 +4,8 @@
 #include <errno.h>
 #include <chrono>
 #include <thread>
+#include <string>
+#include <unordered_map>
 
 //#define GLM_ENABLE_EXPERIMENTAL
 #include <glm/mat4x4.hpp> // glm::mat4
@@ -11,7 +13,6 @@
 #include <glm/glm.hpp>
 //#include <glm/gtx/string_cast.hpp>
 
-#define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
 #include "imgui.h"
@@ -24,64 +25,146 @@
 
 #include "mesh.hpp"
 #include "obj.hpp"
+#include "cache.hpp"
+#include "stream.hpp"
+#include "compact.hpp"
+#include "simplify.hpp"
+#include "meshlet.hpp"
+#include "instance.hpp"
+#include "texgen.hpp"
+#include "pacing.hpp"
+#include "headless.hpp"
+#include "png.hpp"
+#include "batch.hpp"
+#include "framebench.hpp"
+#include "profiler.hpp"
+#include "texture.hpp"
 
 MeshSettings *mesh_set;
+std::chrono::steady_clock::time_point launch_time;
+
+// binding points fixos: qualquer programa com os mesmos blocos le os mesmos buffers
+#define FRAME_BLOCK_BINDING 0
+#define LIGHT_BLOCK_BINDING 1
+
+// espelhos std140 dos blocos abaixo, vec3 seguido de float ocupa 16 bytes
+typedef struct {
+  glm::mat4 view;
+  glm::mat4 projection;
+  glm::vec3 camera_position;
+  float time;
+  glm::vec2 resolution;
+  float pad[2];
+} FrameBlock;
+
+typedef struct {
+  glm::vec3 light_position;
+  float ka;
+  glm::vec3 light_color;
+  float kd;
+  float ks;
+  float ksb;
+  float pad[2];
+} LightBlock;
+
+static_assert(sizeof(FrameBlock) == 160 && offsetof(FrameBlock, resolution) == 144, "FrameBlock fora do std140");
+static_assert(sizeof(LightBlock) == 48 && offsetof(LightBlock, ks) == 32, "LightBlock fora do std140");
+
+// Frame muda todo frame (v_time), Light so quando mesh_set->dirty pede
+const static char *uniform_blocks_source = R"(
+  layout (std140) uniform Frame {
+    mat4 v_view;
+    mat4 v_projection;
+    vec3 v_camera_position;
+    float v_time;
+    vec2 v_resolution;
+  };
+
+  layout (std140) uniform Light {
+    vec3 v_light_position;
+    float v_ka;
+    vec3 v_light_color;
+    float v_kd;
+    float v_ks;
+    float v_ksb;
+  };
+)";
 
+// o #version, os #defines da variante e os blocos vem antes, em compile_shaders
 const static char *vertex_shader_source = R"(
-  #version 330 core
+  #ifdef COMPACT
+  // posicao unorm16 na caixa, normal snorm16 no octaedro
+  layout (location = 0) in vec3 v_pos;
+  layout (location = 1) in vec2 v_normal;
+  uniform vec3 v_quant_min;
+  uniform vec3 v_quant_scale;
+
+  vec4 decode_position() {
+    return vec4(v_quant_min + v_pos * v_quant_scale, 1.0);
+  }
+
+  vec3 decode_normal() {
+    vec3 n = vec3(v_normal, 1.0 - abs(v_normal.x) - abs(v_normal.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+  }
+  #else
   layout (location = 0) in vec4 v_pos;
   layout (location = 1) in vec3 v_normal;
+
+  vec4 decode_position() {
+    return v_pos;
+  }
+
+  vec3 decode_normal() {
+    return v_normal;
+  }
+  #endif
   layout (location = 2) in vec4 v_color;
+  layout (location = 3) in vec2 v_texcoord;
+  layout (location = 4) in mat4 v_instance; // identidade sem instancing
   uniform mat4 v_model;
-  uniform mat4 v_view;
-  uniform mat4 v_projection;
+  uniform mat3 v_normal_matrix; // inversa transposta de v_model, feita no draw
   out vec4 color;
   out vec3 normal;
   out vec3 frag_pos;
-  out vec3 vpos;
+  out vec2 texcoord;
 
   void main() {
-    gl_Position = v_projection * v_view * v_model * v_pos;
+    vec4 pos = decode_position();
+    mat4 model = v_model * v_instance;
+    gl_Position = v_projection * v_view * model * pos;
     color = v_color;
-    normal = mat3(transpose(inverse(v_model))) * v_normal;
-    frag_pos = vec3(v_model * v_pos);
-    vpos = vec3(v_pos);
+    // instancias so giram e escalam por igual, mat3(v_instance) basta
+    normal = normalize(v_normal_matrix * (mat3(v_instance) * decode_normal()));
+    frag_pos = vec3(model * pos);
+    texcoord = v_texcoord;
   };
 )";
 
 // (color * v_color) * v_time
+// a variante define LIGHT e TEXTURED, cada programa so tem o caminho do seu modo
 const static char *fragment_shader_source = R"(
-  #version 330 core
   in vec4 color;
   in vec3 normal;
   in vec3 frag_pos;
-  in vec3 vpos;
+  in vec2 texcoord;
 
-  uniform vec2 v_resolution;
-  uniform float v_time;
   uniform vec2 v_mouse_pos;
 
-  uniform int v_light;
-  uniform vec3 v_camera_position;
-  uniform vec3 v_light_position;
-  uniform vec3 v_light_color;
-  uniform float v_ka;
-  uniform float v_kd;
-  uniform float v_ks;
-  uniform float v_ksb;
-  uniform int v_tex_mode;
-
+  #ifdef TEX_ARRAY
+  uniform sampler2DArray tex;
+  uniform int v_layer; // camada do --texarray
+  #else
   uniform sampler2D tex;
+  #endif
 
   out vec4 FragColor;
 
-  #define PI 3.1415926535897932384626433832795
-  #define NO_TEX 0
-  #define ORTHO 1
-  #define CIL 2
-  #define SPH 3
-
 
+  #ifdef LIGHT
   vec4 phong() {
      vec3 ambient = v_ka * v_light_color;
 
@@ -97,57 +180,62 @@ const static char *fragment_shader_source = R"(
      vec4 out_light = vec4(ambient + diffuse + specular, 1.0f);
      return out_light;
   }
-
-  vec2 ortho(vec3 pos) {
-    return pos.xy + 0.5f; // -1 .. 1
-  }
-
-  vec2 cil(vec3 pos) {
-    float u = (PI + atan(pos.z, pos.x)) / (2 * PI);
-    float v = 0.5f + (0.5f * pos.y);
-    return vec2(u, v);
-  }
-
-  vec2 sph(vec3 pos) {
-    float u = (PI + atan(pos.z, pos.x)) / (2 * PI);
-    float v = (acos(pos.y / (length(pos.xyz)))) / PI;
-    return vec2(u, v);
-  }
-
+  #endif
 
   void main()
   {
-     vec4 light = v_light == 1 ? phong() : vec4(1.0f);
-     vec4 color = vec4(0.5f + 0.5 * cos(v_time + color.xyz + vec3(0.0f, 2.0f, 4.0f)), 1.0f);
+  #ifdef LIGHT
+     vec4 light = phong();
+  #else
+     vec4 light = vec4(1.0f);
+  #endif
 
-     vec2 uv = vpos.xy;
-     switch (v_tex_mode) {
-     case ORTHO:
-       uv = ortho(vpos.xyz);
-       break;
-     case CIL:
-       uv = cil(vpos.xyz);
-       break;
-     case SPH:
-       uv = sph(vpos.xyz);
-       break;
-     case NO_TEX:
-     default:
-      break;
-     }
-
-     vec4 tex_color = texture(tex, uv);
-     vec4 out_color = light * (v_tex_mode > 0 ? tex_color : color);
-
-     FragColor = out_color;
+  #ifndef TEXTURED
+     vec4 color = vec4(0.5f + 0.5 * cos(v_time + color.xyz + vec3(0.0f, 2.0f, 4.0f)), 1.0f);
+     FragColor = light * color;
+  #else
+     // ORTHO/CIL/SPH ja vem projetados por vertice (TexcoordGenerator)
+  #ifdef TEX_ARRAY
+     FragColor = light * texture(tex, vec3(texcoord, float(v_layer)));
+  #else
+     FragColor = light * texture(tex, texcoord);
+  #endif
+  #endif
   };
 )";
 
-int compile_shaders(uint32_t *shader_program) {
+#define SHADER_VERSION "#version 330 core\n"
+
+// programa linkado com as locations que o draw usa, resolvidas uma vez
+typedef struct {
+  uint32_t id;
+  int v_model;
+  int v_normal_matrix;
+  int v_quant_min;
+  int v_quant_scale;
+  int v_layer;
+} ShaderProgram;
+
+// chave do cache de programas: um bit por #define
+#define VARIANT_LIGHT (1u << 0)
+#define VARIANT_COMPACT (1u << 1)
+#define VARIANT_TEXTURED (1u << 2) // qualquer modo de textura, o uv vem do UVBO
+#define VARIANT_TEX_ARRAY (1u << 3) // com TEXTURED: amostra a camada v_layer do --texarray
+typedef std::unordered_map<uint32_t, ShaderProgram> ProgramCache;
+
+typedef struct {
+  uint32_t frame; // FrameBlock
+  uint32_t light; // LightBlock
+} UniformBuffers;
+
+// defines: linhas "#define X\n" da variante, entram logo depois do #version
+int compile_shaders(ShaderProgram *program, const char *defines) {
+  const char *vertex_sources[] = { SHADER_VERSION, defines, uniform_blocks_source, vertex_shader_source };
+  const char *fragment_sources[] = { SHADER_VERSION, defines, uniform_blocks_source, fragment_shader_source };
 
   // vertex shader
   unsigned int vertex_shader = glCreateShader(GL_VERTEX_SHADER);
-  glShaderSource(vertex_shader, 1, &vertex_shader_source, NULL);
+  glShaderSource(vertex_shader, 4, vertex_sources, NULL);
   glCompileShader(vertex_shader);
   // check for shader compile errors
   int success;
@@ -161,7 +249,7 @@ int compile_shaders(uint32_t *shader_program) {
     }
   // fragment shader
   uint32_t fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
-  glShaderSource(fragment_shader, 1, &fragment_shader_source, NULL);
+  glShaderSource(fragment_shader, 4, fragment_sources, NULL);
   glCompileShader(fragment_shader);
   // check for shader compile errors
   glGetShaderiv(fragment_shader, GL_COMPILE_STATUS, &success);
@@ -172,22 +260,74 @@ int compile_shaders(uint32_t *shader_program) {
       return -1;
     }
   // link shaders
-  *shader_program = glCreateProgram();
-  glAttachShader(*shader_program, vertex_shader);
-  glAttachShader(*shader_program, fragment_shader);
-  glLinkProgram(*shader_program);
+  uint32_t shader_program = glCreateProgram();
+  glAttachShader(shader_program, vertex_shader);
+  glAttachShader(shader_program, fragment_shader);
+  glLinkProgram(shader_program);
   // check for linking errors
-  glGetProgramiv(*shader_program, GL_LINK_STATUS, &success);
+  glGetProgramiv(shader_program, GL_LINK_STATUS, &success);
   if (!success) {
-    glGetProgramInfoLog(*shader_program, 512, NULL, infoLog);
+    glGetProgramInfoLog(shader_program, 512, NULL, infoLog);
     std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
     return -1;
   }
   glDeleteShader(vertex_shader);
   glDeleteShader(fragment_shader);
+
+  program->id = shader_program;
+  program->v_model = glGetUniformLocation(shader_program, "v_model");
+  program->v_normal_matrix = glGetUniformLocation(shader_program, "v_normal_matrix");
+  program->v_quant_min = glGetUniformLocation(shader_program, "v_quant_min");
+  program->v_quant_scale = glGetUniformLocation(shader_program, "v_quant_scale");
+  program->v_layer = glGetUniformLocation(shader_program, "v_layer");
+  uint32_t frame_index = glGetUniformBlockIndex(shader_program, "Frame");
+  uint32_t light_index = glGetUniformBlockIndex(shader_program, "Light");
+  if (frame_index != GL_INVALID_INDEX) glUniformBlockBinding(shader_program, frame_index, FRAME_BLOCK_BINDING);
+  if (light_index != GL_INVALID_INDEX) glUniformBlockBinding(shader_program, light_index, LIGHT_BLOCK_BINDING);
   return 0;
 }
 
+uint32_t shader_variant(const MeshSettings *mesh_set) {
+  uint32_t key = 0;
+  if (mesh_set->light) key |= VARIANT_LIGHT;
+  if (mesh_set->tex_mode != NO_TEX) key |= VARIANT_TEXTURED;
+  if (mesh_set->tex_mode != NO_TEX && !mesh_set->tex_layers.empty()) key |= VARIANT_TEX_ARRAY;
+  if (mesh_set->compact) key |= VARIANT_COMPACT;
+  return key;
+}
+
+std::string variant_defines(uint32_t key) {
+  std::string defines;
+  if (key & VARIANT_LIGHT) defines += "#define LIGHT\n";
+  if (key & VARIANT_COMPACT) defines += "#define COMPACT\n";
+  if (key & VARIANT_TEXTURED) defines += "#define TEXTURED\n";
+  if (key & VARIANT_TEX_ARRAY) defines += "#define TEX_ARRAY\n";
+  return defines;
+}
+
+// compila a variante na primeira vez que ela e pedida
+const ShaderProgram &get_program(ProgramCache *programs, uint32_t key) {
+  auto it = programs->find(key);
+  if (it != programs->end()) return it->second;
+  ShaderProgram program;
+  if (compile_shaders(&program, variant_defines(key).c_str()) != 0) exit(1);
+  return (*programs)[key] = program;
+}
+
+// um buffer por bloco, ligado ao binding point do bloco
+void create_uniform_buffers(UniformBuffers *ubo) {
+  glGenBuffers(1, &ubo->frame);
+  glBindBuffer(GL_UNIFORM_BUFFER, ubo->frame);
+  glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameBlock), NULL, GL_DYNAMIC_DRAW);
+  glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_BLOCK_BINDING, ubo->frame);
+
+  glGenBuffers(1, &ubo->light);
+  glBindBuffer(GL_UNIFORM_BUFFER, ubo->light);
+  glBufferData(GL_UNIFORM_BUFFER, sizeof(LightBlock), NULL, GL_DYNAMIC_DRAW);
+  glBindBufferBase(GL_UNIFORM_BUFFER, LIGHT_BLOCK_BINDING, ubo->light);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
 bool is_key_pressed(GLFWwindow *window, int keycode) {
   int state = glfwGetKey(window, keycode);
   return state == GLFW_PRESS || state == GLFW_REPEAT;
@@ -210,6 +350,7 @@ bool should_quit(GLFWwindow *window) {
 void resize_callback(GLFWwindow* window, int width, int height) {
   glfwGetWindowSize(window, &width, &height);
   glViewport(0, 0, width, height);
+  if (width > 0 && height > 0) mesh_set->resolution = glm::vec2(width, height);
 }
 
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset) {
@@ -251,8 +392,30 @@ glm::quat rotation_calc(glm::vec2 l_mouse_pos, glm::vec2 c_mouse_pos) {
   return glm::angleAxis(angle, glm::normalize(axis));
 }
 
-void draw(uint32_t VAO, uint32_t program, MeshSettings* mesh_set, glm::vec2 c_mouse_pos) {
-  float time = (float)glfwGetTime();
+// raio projetado da esfera envolvente em pixels; cada metade do raio desce uma LOD
+int select_lod(MeshSettings *mesh_set) {
+  float scale = std::max(std::max(mesh_set->scale.x, mesh_set->scale.y), mesh_set->scale.z);
+  float radius = glm::length(mesh_set->bbox_max - mesh_set->bbox_min) * 0.5f * scale;
+  // com instancing cada copia ocupa uma celula da grade
+  radius *= InstanceLayout::instance_scale(mesh_set->instances);
+  float dist = glm::length(mesh_set->camera_position - mesh_set->translate);
+  if (dist <= radius) return 0;
+  float pixels = radius / (dist * tanf(glm::radians(45.0f) * 0.5f)) * (mesh_set->resolution.y * 0.5f);
+  if (pixels >= LOD_FULL_PIXELS) return 0;
+  int lod = (int)floorf(log2f(LOD_FULL_PIXELS / std::max(pixels, 1.0f))) + 1;
+  return std::min(lod, (int)mesh_set->lods.size() - 1);
+}
+
+// sobe o modelo e a matriz das normais; com escala uniforme a inversa transposta
+// e o proprio mat3 a menos do tamanho, que o vertex shader ja normaliza
+void set_model(const ShaderProgram &program, const glm::mat4 &model, bool uniform_scale) {
+  glm::mat3 normal_matrix = glm::mat3(model);
+  if (!uniform_scale) normal_matrix = glm::transpose(glm::inverse(normal_matrix));
+  glUniformMatrix4fv(program.v_model, 1, GL_FALSE, &model[0][0]);
+  glUniformMatrix3fv(program.v_normal_matrix, 1, GL_FALSE, &normal_matrix[0][0]);
+}
+
+void draw(uint32_t VAO, ProgramCache *programs, const UniformBuffers &ubo, MeshSettings* mesh_set, glm::vec2 c_mouse_pos, float time) {
   glm::mat4 view = glm::mat4(1.0f);
   view = glm::lookAt(mesh_set->camera_position, 
 		     glm::vec3(0.0f, 0.0f, 0.0f), 
@@ -274,48 +437,537 @@ void draw(uint32_t VAO, uint32_t program, MeshSettings* mesh_set, glm::vec2 c_mo
   model = glm::scale(model, mesh_set->scale);
   //model = glm::translate(model, -mesh_set->center); nao precisa mais
 
-  projection = glm::perspective(glm::radians(45.0f), (float)WIDTH / (float)HEIGHT, 0.1f, 100.0f);
-
-  int v_resolution = glGetUniformLocation(program, "v_resolution");
-  int v_model = glGetUniformLocation(program, "v_model");
-  int v_view = glGetUniformLocation(program, "v_view");
-  int v_projection = glGetUniformLocation(program, "v_projection");
-  int v_time = glGetUniformLocation(program, "v_time");
-  int v_light = glGetUniformLocation(program, "v_light");
-  int v_camera_position = glGetUniformLocation(program, "v_camera_position");
-  int v_light_position = glGetUniformLocation(program, "v_light_position");
-  int v_light_color = glGetUniformLocation(program, "v_light_color");
-  int v_ka = glGetUniformLocation(program, "v_ka");
-  int v_kd = glGetUniformLocation(program, "v_kd");
-  int v_ks = glGetUniformLocation(program, "v_ks");
-  int v_ksb = glGetUniformLocation(program, "v_ksb");
-  int v_tex_mode = glGetUniformLocation(program, "v_tex_mode");
-
-  glUniformMatrix4fv(v_model, 1, GL_FALSE, &model[0][0]);
-  glUniformMatrix4fv(v_view, 1, GL_FALSE, &view[0][0]);
-  glUniformMatrix4fv(v_projection, 1, GL_FALSE, &projection[0][0]);
-
-  glUniform2f(v_resolution, mesh_set->resolution.x, mesh_set->resolution.y);
-  glUniform1f(v_time, time);
-  glUniform1i(v_light, (int)mesh_set->light);
-  glUniform1i(v_tex_mode, (int)mesh_set->tex_mode);
-  glUniform3f(v_camera_position, mesh_set->camera_position[0], mesh_set->camera_position[1], mesh_set->camera_position[2]);
-  glUniform3f(v_light_position, mesh_set->light_position[0], mesh_set->light_position[1], mesh_set->light_position[2]);
-  glUniform3f(v_light_color, mesh_set->light_color[0], mesh_set->light_color[1], mesh_set->light_color[2]);
-  glUniform1f(v_ka, mesh_set->ka);
-  glUniform1f(v_kd, mesh_set->kd);
-  glUniform1f(v_ks, mesh_set->ks);
-  glUniform1f(v_ksb, mesh_set->ksb);
+  if (mesh_set->stream != nullptr) {
+    // previa do --stream: vertices ainda crus, normaliza com a caixa lida ate agora
+    glm::vec3 size = mesh_set->bbox_max - mesh_set->bbox_min;
+    float maior_dim = std::max(std::max(size.x, size.y), size.z);
+    model = glm::scale(model, glm::vec3(maior_dim > 0.0f ? 1.0f / maior_dim : 1.0f));
+    model = glm::translate(model, -mesh_set->center);
+  }
+
+  projection = glm::perspective(glm::radians(45.0f), mesh_set->resolution.x / mesh_set->resolution.y, 0.1f, 100.0f);
+
+  if (mesh_set->profiler != nullptr) mesh_set->profiler->begin(STAGE_UNIFORMS);
+  // programa do modo atual de luz e textura, sem branch por fragmento
+  const ShaderProgram &program = get_program(programs, shader_variant(mesh_set));
+  glUseProgram(program.id);
+
+  // as partes da cena e o --stream so acrescentam escala uniforme
+  bool uniform_scale = mesh_set->scale.x == mesh_set->scale.y && mesh_set->scale.y == mesh_set->scale.z;
+  set_model(program, model, uniform_scale);
+
+  FrameBlock frame = {
+    .view = view,
+    .projection = projection,
+    .camera_position = mesh_set->camera_position,
+    .time = time,
+    .resolution = mesh_set->resolution,
+    .pad = { 0.0f, 0.0f },
+  };
+  glBindBuffer(GL_UNIFORM_BUFFER, ubo.frame);
+  glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameBlock), &frame);
+
+  if (mesh_set->dirty & DIRTY_LIGHT) {
+    LightBlock light = {
+      .light_position = mesh_set->light_position,
+      .ka = mesh_set->ka,
+      .light_color = mesh_set->light_color,
+      .kd = mesh_set->kd,
+      .ks = mesh_set->ks,
+      .ksb = mesh_set->ksb,
+      .pad = { 0.0f, 0.0f },
+    };
+    glBindBuffer(GL_UNIFORM_BUFFER, ubo.light);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(LightBlock), &light);
+    mesh_set->dirty &= ~DIRTY_LIGHT;
+  }
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+  if (mesh_set->compact) {
+    // mesma caixa usada pelo VertexPacker
+    glm::vec3 extent = mesh_set->bbox_max - mesh_set->bbox_min;
+    glUniform3f(program.v_quant_min, mesh_set->bbox_min[0], mesh_set->bbox_min[1], mesh_set->bbox_min[2]);
+    glUniform3f(program.v_quant_scale, extent[0], extent[1], extent[2]);
+  }
+  // trocar de textura no --texarray e so isso
+  if (program.v_layer >= 0) glUniform1i(program.v_layer, mesh_set->tex_layer);
   glLineWidth(mesh_set->stroke);
+  if (mesh_set->profiler != nullptr) mesh_set->profiler->end(STAGE_UNIFORMS);
+
+  ProfileScope draw_scope(mesh_set->profiler, STAGE_DRAW);
+  uint64_t first = 0;
+  uint64_t count = mesh_set->t_index;
+  if (!mesh_set->lods.empty()) {
+    mesh_set->lod = mesh_set->forced_lod >= 0 ? mesh_set->forced_lod : select_lod(mesh_set);
+    mesh_set->lod = std::min(mesh_set->lod, (int)mesh_set->lods.size() - 1);
+    first = mesh_set->lods[mesh_set->lod].offset;
+    count = mesh_set->lods[mesh_set->lod].count;
+  }
+  uint64_t index_size = mesh_set->short_indices ? sizeof(uint16_t) : sizeof(uint32_t);
+  uint32_t index_type = mesh_set->short_indices ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+
+  uint32_t instances = (uint32_t)std::max(mesh_set->instances, 1);
 
   glBindVertexArray(VAO);
   //glDrawArrays(GL_TRIANGLES, 0, mesh_set->t_verts);
-  glDrawElements(GL_TRIANGLES, mesh_set->t_index, GL_UNSIGNED_INT, 0);
+  if (!mesh_set->parts.empty() && instances > 1) {
+    // cena instanciada: o culling por parte nao vale para as copias
+    mesh_set->visible_parts = mesh_set->parts.size();
+    mesh_set->visible_index = 0;
+    for (size_t p = 0; p < mesh_set->parts.size(); p++) {
+      const MeshPart &part = mesh_set->parts[p];
+      glm::mat4 part_model = model * part.transform;
+      set_model(program, part_model, uniform_scale);
+      glDrawElementsInstancedBaseVertex(GL_TRIANGLES, part.t_index, GL_UNSIGNED_INT, (void*)(part.first_index * sizeof(uint32_t)),
+					instances, part.base_vertex);
+      mesh_set->visible_index += part.t_index * instances;
+    }
+  } else if (!mesh_set->parts.empty()) {
+    // cena: uma faixa do EBO por parte, com o modelo da parte e sem trocar de VAO
+    glm::mat4 view_projection = projection * view;
+    mesh_set->visible_parts = 0;
+    mesh_set->visible_index = 0;
+    for (size_t p = 0; p < mesh_set->parts.size(); p++) {
+      const MeshPart &part = mesh_set->parts[p];
+      glm::mat4 part_model = model * part.transform;
+      if (mesh_set->cull_frustum) {
+	glm::vec4 planes[6];
+	MeshletBuilder::frustum_planes(view_projection * part_model, planes);
+	glm::vec3 part_center = (part.bbox_min + part.bbox_max) / 2.0f;
+	float radius = glm::length(part.bbox_max - part.bbox_min) / 2.0f;
+	if (MeshletBuilder::sphere_outside(planes, part_center, radius)) continue;
+      }
+      set_model(program, part_model, uniform_scale);
+      glDrawElementsBaseVertex(GL_TRIANGLES, part.t_index, GL_UNSIGNED_INT, (void*)(part.first_index * sizeof(uint32_t)), part.base_vertex);
+      mesh_set->visible_parts++;
+      mesh_set->visible_index += part.t_index;
+    }
+  } else if (!mesh_set->meshlets.empty() && first == 0 && instances == 1) {
+    // meshlets da LOD0: culling no espaco do modelo, o modelo ja inclui a rotacao do trackball
+    static thread_local std::vector<int32_t> counts;
+    static thread_local std::vector<const void *> offsets;
+    glm::mat4 mvp = projection * view * model;
+    glm::vec3 camera = glm::vec3(glm::inverse(model) * glm::vec4(mesh_set->camera_position, 1.0f));
+    // no wireframe as arestas de tras continuam visiveis
+    bool cone = mesh_set->cull_cone && mesh_set->mode == FILL_POLYGON;
+    mesh_set->visible_index = MeshletBuilder::cull(mesh_set->meshlets, mvp, camera, mesh_set->cull_frustum, cone,
+						   index_size, &counts, &offsets);
+    if (!counts.empty()) glMultiDrawElements(GL_TRIANGLES, counts.data(), index_type, offsets.data(), counts.size());
+  } else if (instances > 1) {
+    mesh_set->visible_index = count * instances;
+    glDrawElementsInstanced(GL_TRIANGLES, count, index_type, (void*)(first * index_size), instances);
+  } else {
+    mesh_set->visible_index = count;
+    glDrawElements(GL_TRIANGLES, count, index_type, (void*)(first * index_size));
+  }
   //glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
   //glUniform4f(v_bord_color, 0.1f, 0.0f, 0.0f, 1.0f);  
   //glDrawArrays(GL_TRIANGLES, 0, mesh_set->t_verts);
 }
 
+// aumenta o buffer mantendo o nome (o VAO continua apontando para ele) e o conteudo
+void grow_buffer(uint32_t buffer, uint64_t used, uint64_t *capacity, uint64_t needed) {
+  uint64_t new_capacity = std::max(*capacity * 2, needed);
+  uint32_t tmp;
+  glGenBuffers(1, &tmp);
+  glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, tmp);
+  glBufferData(GL_COPY_WRITE_BUFFER, used, NULL, GL_STREAM_COPY);
+  if (used) glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, used);
+  glBufferData(GL_COPY_READ_BUFFER, new_capacity, NULL, GL_STATIC_DRAW);
+  if (used) glCopyBufferSubData(GL_COPY_WRITE_BUFFER, GL_COPY_READ_BUFFER, 0, 0, used);
+  glDeleteBuffers(1, &tmp);
+  *capacity = new_capacity;
+}
+
+void append_buffer(uint32_t buffer, uint64_t used, uint64_t *capacity, const void *data, uint64_t size) {
+  if (used + size > *capacity) grow_buffer(buffer, used, capacity, used + size);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+  glBufferSubData(GL_COPY_WRITE_BUFFER, used, size, data);
+}
+
+// refaz o buffer de instancias quando o numero de copias ou a disposicao mudam
+void instance_upload(MeshSettings *mesh_set, uint32_t buffer, int *uploaded, int *uploaded_layout) {
+  mesh_set->instances = std::min(std::max(mesh_set->instances, 1), INSTANCE_MAX);
+  if (mesh_set->instances == *uploaded && mesh_set->instance_layout == *uploaded_layout) return;
+  std::vector<glm::mat4> transforms;
+  InstanceLayout::build(mesh_set->instances, (INSTANCE_LAYOUT)mesh_set->instance_layout, &transforms);
+  glBindBuffer(GL_ARRAY_BUFFER, buffer);
+  glBufferData(GL_ARRAY_BUFFER, transforms.size() * sizeof(glm::mat4), transforms.data(), GL_STATIC_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  *uploaded = mesh_set->instances;
+  *uploaded_layout = mesh_set->instance_layout;
+}
+
+// sobe os pedacos que o StreamLoader ja entregou, no maximo STREAM_UPLOADS_PER_FRAME por frame;
+// false se o loader falhou, o loop sai normalmente
+#define STREAM_UPLOADS_PER_FRAME 8
+bool stream_upload(MeshSettings *mesh_set, uint32_t VBO, uint32_t EBO, uint64_t *vbo_capacity, uint64_t *ebo_capacity) {
+  StreamChunk chunk;
+  for (int n = 0; n < STREAM_UPLOADS_PER_FRAME && mesh_set->stream->pop(&chunk); n++) {
+    if (!chunk.error.empty()) {
+      std::cerr << chunk.error << std::endl;
+      delete mesh_set->stream;
+      mesh_set->stream = nullptr;
+      mesh_set->t_verts = 0; // a previa nao tem vertices na CPU para o uv gerado
+      mesh_set->t_index = 0;
+      return false;
+    }
+    if (chunk.final) {
+      glBindBuffer(GL_COPY_WRITE_BUFFER, VBO);
+      glBufferData(GL_COPY_WRITE_BUFFER, chunk.vertices.size() * sizeof(Vertex), chunk.vertices.data(), GL_STATIC_DRAW);
+      glBindBuffer(GL_COPY_WRITE_BUFFER, EBO);
+      glBufferData(GL_COPY_WRITE_BUFFER, chunk.indices.size() * sizeof(uint32_t), chunk.indices.data(), GL_STATIC_DRAW);
+      *vbo_capacity = chunk.vertices.size() * sizeof(Vertex);
+      *ebo_capacity = chunk.indices.size() * sizeof(uint32_t);
+      mesh_set->vertices.swap(chunk.vertices);
+      mesh_set->indices.swap(chunk.indices);
+      mesh_set->t_verts = mesh_set->vertices.size();
+      mesh_set->t_index = mesh_set->indices.size();
+      mesh_set->center = chunk.center;
+      mesh_set->lods.swap(chunk.lods);
+      mesh_set->meshlets.swap(chunk.meshlets);
+      mesh_set->has_texcoords = chunk.has_texcoords; // libera a tecla 5
+      mesh_set->bbox_min = chunk.bbox_min;
+      mesh_set->bbox_max = chunk.bbox_max;
+      delete mesh_set->stream;
+      mesh_set->stream = nullptr;
+      std::cout << "stream completo: " << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - launch_time).count() << " ms" << std::endl;
+      break;
+    }
+
+    if (!chunk.vertices.empty()) {
+      append_buffer(VBO, mesh_set->t_verts * sizeof(Vertex), vbo_capacity, chunk.vertices.data(), chunk.vertices.size() * sizeof(Vertex));
+      mesh_set->t_verts += chunk.vertices.size();
+    }
+    if (!chunk.indices.empty()) {
+      append_buffer(EBO, mesh_set->t_index * sizeof(uint32_t), ebo_capacity, chunk.indices.data(), chunk.indices.size() * sizeof(uint32_t));
+      mesh_set->t_index += chunk.indices.size();
+    }
+    mesh_set->bbox_min = chunk.bbox_min;
+    mesh_set->bbox_max = chunk.bbox_max;
+    mesh_set->center = (chunk.bbox_min + chunk.bbox_max) / 2.0f;
+  }
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  glBindBuffer(GL_COPY_READ_BUFFER, 0);
+  return true;
+}
+
+// o que esta no UVBO e no fim do VBO para o modo de textura
+typedef struct {
+  int mode;     // TEXTURE_MODE gerado, -1 para refazer
+  bool patched; // EBO com os indices das copias da costura
+} TexcoordState;
+
+void upload_indices(uint32_t EBO, const uint32_t *indices, uint64_t t_index, bool short_indices) {
+  glBindBuffer(GL_COPY_WRITE_BUFFER, EBO);
+  if (short_indices) {
+    std::vector<uint16_t> shorts(indices, indices + t_index);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, 0, t_index * sizeof(uint16_t), shorts.data());
+  } else {
+    glBufferSubData(GL_COPY_WRITE_BUFFER, 0, t_index * sizeof(uint32_t), indices);
+  }
+}
+
+// gera o uv do modo ativo quando ele muda: copias da costura no fim do VBO
+// (bytes de vertex_data, stride por vertice), EBO remendado e o UVBO
+void texcoord_upload(MeshSettings *mesh_set, uint32_t VAO, uint32_t VBO, uint32_t EBO, uint32_t UVBO,
+		     const void *vertex_data, uint64_t stride, uint64_t *vbo_capacity, TexcoordState *state) {
+  // no --stream o VBO ainda esta crescendo, so gera quando a malha fecha
+  TEXTURE_MODE mode = mesh_set->stream != nullptr ? NO_TEX : mesh_set->tex_mode;
+  if ((int)mode == state->mode) return;
+  state->mode = mode;
+
+  glBindVertexArray(VAO);
+  if (mode == NO_TEX) {
+    glDisableVertexAttribArray(3);
+    glBindVertexArray(0);
+    return;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<IndexRange> ranges;
+  for (const MeshPart &part : mesh_set->parts) ranges.push_back((IndexRange){ part.first_index, part.t_index, part.base_vertex });
+  if (ranges.empty()) ranges.push_back((IndexRange){ 0, mesh_set->t_index, 0 });
+  uint64_t max_verts = mesh_set->short_indices ? 65536 : UINT32_MAX;
+
+  TexcoordStream uv;
+  TexcoordGenerator::generate(mode, mesh_vertex_data(mesh_set), mesh_set->t_verts, mesh_index_data(mesh_set), mesh_set->t_index,
+			      ranges, max_verts, &uv);
+
+  if (!uv.seam_verts.empty()) {
+    std::vector<uint8_t> copies(uv.seam_verts.size() * stride);
+    for (size_t i = 0; i < uv.seam_verts.size(); i++) {
+      memcpy(&copies[i * stride], (const uint8_t *)vertex_data + uv.seam_verts[i] * stride, stride);
+    }
+    append_buffer(VBO, mesh_set->t_verts * stride, vbo_capacity, copies.data(), copies.size());
+  }
+  if (!uv.indices.empty()) {
+    upload_indices(EBO, uv.indices.data(), mesh_set->t_index, mesh_set->short_indices);
+    state->patched = true;
+  } else if (state->patched) {
+    upload_indices(EBO, mesh_index_data(mesh_set), mesh_set->t_index, mesh_set->short_indices);
+    state->patched = false;
+  }
+
+  glBindBuffer(GL_ARRAY_BUFFER, UVBO);
+  if (mesh_set->compact) {
+    std::vector<uint16_t> halfs(2 * uv.uvs.size());
+    for (size_t i = 0; i < uv.uvs.size(); i++) {
+      halfs[2*i+0] = VertexPacker::float_to_half(uv.uvs[i].x);
+      halfs[2*i+1] = VertexPacker::float_to_half(uv.uvs[i].y);
+    }
+    glBufferData(GL_ARRAY_BUFFER, halfs.size() * sizeof(uint16_t), halfs.data(), GL_STATIC_DRAW);
+  } else {
+    glBufferData(GL_ARRAY_BUFFER, uv.uvs.size() * sizeof(glm::vec2), uv.uvs.data(), GL_STATIC_DRAW);
+  }
+  glEnableVertexAttribArray(3); // location 3
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  glBindBuffer(GL_COPY_READ_BUFFER, 0);
+  glBindVertexArray(0);
+
+  // a cada troca para um modo com uv (teclas 2 a 5), nao so na carga
+  const char *names[] = { "none", "ortho", "cil", "sph", "uv" };
+  std::cout << "uv gerado (" << names[mode] << "): " << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count()
+	    << " ms (" << uv.seam_verts.size() << " vertices copiados na costura";
+  if (uv.skipped) std::cout << ", " << uv.skipped << " triangulos sem copia";
+  std::cout << ")" << std::endl;
+}
+
+// tudo que a janela e o --headless compartilham para desenhar a malha
+typedef struct {
+  uint32_t VAO, VBO, EBO, UVBO, INSTBO;
+  uint32_t tex;
+  uint32_t shared_tex;    // --batch: textura ja completa que fica no contexto entre as malhas, 0 sem
+  TextureLoader *texture; // decode ou upload em andamento, nullptr com a textura completa
+  uint32_t tex_array;     // GL_TEXTURE_2D_ARRAY do --texarray, 0 sem
+  TextureArray *layers;   // decode das camadas em andamento, nullptr depois do upload
+  uint64_t vbo_capacity;
+  uint64_t ebo_capacity;
+  CompactMesh compact; // fica para copiar os vertices da costura
+  ProgramCache programs;
+  UniformBuffers ubo;
+  TexcoordState texcoords;
+  int uploaded_instances;
+  int uploaded_layout;
+  bool stream_failed; // o --stream nao carregou, a janela fecha
+} RenderState;
+
+// buffers, shaders e textura; precisa de um contexto GL atual
+void render_init(MeshSettings *mesh_set, RenderState *rs) {
+  if (mesh_set->compact && mesh_set->stream != nullptr) {
+    // a previa do stream chega sem normais e sem a caixa final
+    std::cout << "--compact ignorado com --stream" << std::endl;
+    mesh_set->compact = false;
+  }
+  if (mesh_set->compact && !mesh_set->parts.empty()) {
+    // cada parte tem a sua caixa, o VertexPacker quantiza numa so
+    std::cout << "--compact ignorado com --scene" << std::endl;
+    mesh_set->compact = false;
+  }
+
+  // os programas e os uniform buffers ficam no contexto entre as malhas do --batch
+  if (rs->programs.empty()) create_uniform_buffers(&rs->ubo);
+
+  // todas as combinacoes de luz e textura ja na abertura, trocar de modo nao compila nada
+  uint32_t textured_key = VARIANT_TEXTURED | (mesh_set->tex_layers.empty() ? 0 : VARIANT_TEX_ARRAY);
+  for (uint32_t textured = 0; textured <= textured_key; textured += textured_key) {
+    uint32_t key = textured | (mesh_set->compact ? VARIANT_COMPACT : 0);
+    get_program(&rs->programs, key);
+    get_program(&rs->programs, key | VARIANT_LIGHT);
+  }
+
+  glGenVertexArrays(1, &rs->VAO);
+  glGenBuffers(1, &rs->VBO);
+  glGenBuffers(1, &rs->EBO);
+  glGenBuffers(1, &rs->UVBO);
+  glGenBuffers(1, &rs->INSTBO);
+
+  glBindVertexArray(rs->VAO);
+  
+  glBindBuffer(GL_ARRAY_BUFFER, rs->VBO);
+  rs->vbo_capacity = 0;
+  rs->ebo_capacity = 0;
+  if (mesh_set->stream != nullptr) {
+    // --stream: comeca vazio e cresce conforme os pedacos chegam
+    rs->vbo_capacity = STREAM_CHUNK_VERTS * sizeof(Vertex);
+    rs->ebo_capacity = STREAM_CHUNK_INDICES * sizeof(uint32_t);
+    glBufferData(GL_ARRAY_BUFFER, rs->vbo_capacity, NULL, GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, rs->EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, rs->ebo_capacity, NULL, GL_STATIC_DRAW);
+  } else if (mesh_set->compact) {
+    VertexPacker::pack(mesh_set, &rs->compact);
+    glBufferData(GL_ARRAY_BUFFER, rs->compact.vertices.size() * sizeof(CompactVertex), rs->compact.vertices.data(), GL_STATIC_DRAW);
+    rs->vbo_capacity = rs->compact.vertices.size() * sizeof(CompactVertex);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, rs->EBO);
+    mesh_set->short_indices = !rs->compact.indices.empty();
+    if (mesh_set->short_indices) {
+      glBufferData(GL_ELEMENT_ARRAY_BUFFER, rs->compact.indices.size() * sizeof(uint16_t), rs->compact.indices.data(), GL_STATIC_DRAW);
+    } else {
+      glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh_set->t_index * sizeof(uint32_t), mesh_index_data(mesh_set), GL_STATIC_DRAW);
+    }
+
+    uint64_t before = mesh_set->t_verts * sizeof(Vertex) + mesh_set->t_index * sizeof(uint32_t);
+    uint64_t after = rs->compact.vertices.size() * sizeof(CompactVertex)
+      + mesh_set->t_index * (mesh_set->short_indices ? sizeof(uint16_t) : sizeof(uint32_t));
+    std::cout << "compact: " << before / 1024 << " KB -> " << after / 1024 << " KB" << std::endl;
+
+    glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, position));
+    glEnableVertexAttribArray(0); // location 0
+
+    glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, normal));
+    glEnableVertexAttribArray(1); // location 1
+
+    glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, color));
+    glEnableVertexAttribArray(2); // location 2
+
+  } else {
+    // com o cache as paginas mapeadas vao direto para o driver
+    glBufferData(GL_ARRAY_BUFFER, mesh_set->t_verts * sizeof(Vertex), mesh_vertex_data(mesh_set), GL_STATIC_DRAW);
+    rs->vbo_capacity = mesh_set->t_verts * sizeof(Vertex);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, rs->EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh_set->t_index * sizeof(uint32_t), mesh_index_data(mesh_set), GL_STATIC_DRAW);
+  }
+
+  if (!mesh_set->compact) {
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, position));
+    glEnableVertexAttribArray(0); // location 0
+
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+    glEnableVertexAttribArray(1); // location 1
+
+    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, color));
+    glEnableVertexAttribArray(2); // location 2
+  }
+
+  // uv do modo de textura num buffer separado (half no --compact), ligado pelo texcoord_upload
+  glBindBuffer(GL_ARRAY_BUFFER, rs->UVBO);
+  if (mesh_set->compact) {
+    glVertexAttribPointer(3, 2, GL_HALF_FLOAT, GL_FALSE, 2 * sizeof(uint16_t), (void*)0);
+  } else {
+    glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), (void*)0);
+  }
+
+  // mat4 por instancia, uma coluna por location (4 a 7); comeca com uma identidade
+  rs->uploaded_instances = 0;
+  rs->uploaded_layout = -1;
+  instance_upload(mesh_set, rs->INSTBO, &rs->uploaded_instances, &rs->uploaded_layout);
+  glBindBuffer(GL_ARRAY_BUFFER, rs->INSTBO);
+  for (int c = 0; c < 4; c++) {
+    glVertexAttribPointer(4 + c, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(c * sizeof(glm::vec4)));
+    glEnableVertexAttribArray(4 + c); // location 4 + c
+    glVertexAttribDivisor(4 + c, 1);
+  }
+
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  glBindVertexArray(0); 
+
+  rs->texcoords = (TexcoordState){ .mode = -1, .patched = false };
+  rs->stream_failed = false;
+
+  glEnable(GL_DEPTH_TEST);
+
+  glEnable(GL_LINE_SMOOTH);
+  glEnable(GL_POLYGON_SMOOTH);
+  glEnable(GL_MULTISAMPLE);
+
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+  // o primeiro frame sai com o placeholder, a textura chega pelo render_frame
+  rs->texture = nullptr;
+  rs->tex_array = 0;
+  rs->layers = nullptr;
+  if (rs->shared_tex != 0) {
+    // a mesma textura em todas as malhas do --batch: sem decode nem upload de novo
+    rs->tex = rs->shared_tex;
+    return;
+  }
+  glGenTextures(1, &rs->tex);
+  TextureLoader::placeholder(rs->tex);
+  if (!mesh_set->tex_layers.empty()) {
+    GLint max_layers = 0, max_size = 0;
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &max_layers);
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+    if ((int)mesh_set->tex_layers.size() > max_layers) {
+      std::cout << "--texarray: o driver aceita " << max_layers << " camadas, o resto fica de fora" << std::endl;
+      mesh_set->tex_layers.resize(max_layers);
+    }
+    glGenTextures(1, &rs->tex_array);
+    TextureArray::placeholder(rs->tex_array);
+    rs->layers = new TextureArray(mesh_set->tex_layers, std::min(max_size, TEXTURE_ARRAY_MAX_SIZE));
+    rs->layers->start();
+  } else if (mesh_set->tex_file != nullptr) {
+    rs->texture = new TextureLoader(mesh_set->tex_file, mesh_set->tex_format, mesh_set->tex_cache);
+    rs->texture->start();
+  }
+}
+
+// --headless e --batch desenham um frame so: espera a textura inteira
+void texture_finish(RenderState *rs) {
+  if (rs->layers != nullptr) {
+    rs->layers->finish(rs->tex_array);
+    delete rs->layers;
+    rs->layers = nullptr;
+  }
+  if (rs->texture == nullptr) return;
+  rs->texture->finish(rs->tex);
+  delete rs->texture;
+  rs->texture = nullptr;
+}
+
+// apaga o que e da malha; programas e uniform buffers continuam para a proxima
+void render_release(RenderState *rs) {
+  uint32_t buffers[] = { rs->VBO, rs->EBO, rs->UVBO, rs->INSTBO };
+  glDeleteBuffers(4, buffers);
+  glDeleteVertexArrays(1, &rs->VAO);
+  delete rs->texture;
+  rs->texture = nullptr;
+  if (rs->tex != rs->shared_tex) glDeleteTextures(1, &rs->tex);
+  delete rs->layers;
+  rs->layers = nullptr;
+  if (rs->tex_array != 0) glDeleteTextures(1, &rs->tex_array);
+  rs->compact = CompactMesh();
+}
+
+void render_frame(MeshSettings *mesh_set, RenderState *rs, glm::vec2 mouse, float time) {
+  glPolygonMode(GL_FRONT_AND_BACK, mesh_set->mode == FILL_POLYGON ? GL_FILL : GL_LINE);
+  glClearColor(mesh_set->bg_color[0], mesh_set->bg_color[1], mesh_set->bg_color[2], 1.0f);
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, rs->tex);
+  if (rs->tex_array != 0) glBindTexture(GL_TEXTURE_2D_ARRAY, rs->tex_array);
+
+  {
+    ProfileScope scope(mesh_set->profiler, STAGE_UPLOAD);
+    if (rs->texture != nullptr && rs->texture->upload(rs->tex, false)) {
+      delete rs->texture;
+      rs->texture = nullptr;
+    }
+    if (rs->layers != nullptr && rs->layers->upload(rs->tex_array)) {
+      delete rs->layers;
+      rs->layers = nullptr;
+    }
+    if (mesh_set->stream != nullptr) {
+      rs->stream_failed = !stream_upload(mesh_set, rs->VBO, rs->EBO, &rs->vbo_capacity, &rs->ebo_capacity);
+      if (rs->stream_failed) return;
+      // o upload final troca o VBO e o EBO inteiros
+      if (mesh_set->stream == nullptr) rs->texcoords = (TexcoordState){ .mode = -1, .patched = false };
+    }
+    texcoord_upload(mesh_set, rs->VAO, rs->VBO, rs->EBO, rs->UVBO,
+		    mesh_set->compact ? (const void *)rs->compact.vertices.data() : (const void *)mesh_vertex_data(mesh_set),
+		    mesh_set->compact ? sizeof(CompactVertex) : sizeof(Vertex), &rs->vbo_capacity, &rs->texcoords);
+    instance_upload(mesh_set, rs->INSTBO, &rs->uploaded_instances, &rs->uploaded_layout);
+  }
+
+  draw(rs->VAO, &rs->programs, rs->ubo, mesh_set, mouse, time);
+}
+
 void loop(GLFWwindow *window) {
 
   ImGui::CreateContext();
@@ -365,75 +1017,17 @@ void loop(GLFWwindow *window) {
   glfwSetFramebufferSizeCallback(window, resize_callback);
   glfwSetScrollCallback(window, scroll_callback);
 
-  uint32_t program;
-  int error = compile_shaders(&program);
-  if (error != 0) exit(1);
-
-  uint32_t VAO, VBO, EBO;
-
-  glGenVertexArrays(1, &VAO);
-  glGenBuffers(1, &VBO);
-  glGenBuffers(1, &EBO);
-
-  glBindVertexArray(VAO);
-  
-  glBindBuffer(GL_ARRAY_BUFFER, VBO);
-  glBufferData(GL_ARRAY_BUFFER, mesh_set->t_verts * sizeof(Vertex), &mesh_set->vertices[0], GL_STATIC_DRAW);
-
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh_set->indices.size() * sizeof(uint32_t), &mesh_set->indices[0], GL_STATIC_DRAW);
-  
-  glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, position));
-  glEnableVertexAttribArray(0); // location 0
-
-  glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
-  glEnableVertexAttribArray(1); // location 1
-
-  glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, color));
-  glEnableVertexAttribArray(2); // location 1
-
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-  glBindVertexArray(0); 
-
-  glEnable(GL_DEPTH_TEST);
-
-  glEnable(GL_LINE_SMOOTH);
-  glEnable(GL_POLYGON_SMOOTH);
-  glEnable(GL_MULTISAMPLE);
-
-  stbi_set_flip_vertically_on_load(1);
-  unsigned int tex;
-  
-  glGenTextures(1, &tex);
-  glBindTexture(GL_TEXTURE_2D, tex);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-  int i_width, i_height, nr_channels;
-
-  if (mesh_set->tex_file != nullptr) {
-    unsigned char *data = stbi_load(mesh_set->tex_file, &width, &height, &nr_channels, 0);
-    if (data) {
-      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-      glGenerateMipmap(GL_TEXTURE_2D);
-    } else {
-      std::cout << "ERROR: Failed to load texture" << std::endl;
-      exit(1);
-    }
-  
-    stbi_image_free(data); // loaded
-  }
-  (void)i_width, (void)i_height;
+  RenderState rs;
+  rs.shared_tex = 0;
+  render_init(mesh_set, &rs);
 
   float start_time = glfwGetTime();
-  float delta = 0.0f;
-  float total_time = 0.0f;
+  FramePacer pacer;
+  if (mesh_set->bench != nullptr) mesh_set->bench->start();
+  Profiler profiler;
+  profiler.init();
+  mesh_set->profiler = &profiler;
 
-  float frame_time = 1.0f / 30.0f;
-  
   float click_time = 0.0f;
   float threshold = 0.2f; // mouse
 
@@ -441,9 +1035,13 @@ void loop(GLFWwindow *window) {
   float key_threshold = 0.2f;
   uint32_t total_click = 0;
   bool help = false;
+  bool first_frame = true;
   
   while (!quit) {
+    profiler.frame_begin();
+    glm::vec2 mouse = mesh_set->bench != nullptr ? mesh_set->bench->frame_begin(mesh_set) : glm::vec2(0.0f);
 
+    profiler.begin(STAGE_IMGUI_BUILD);
     ImGui_ImplOpenGL3_NewFrame();
     ImGui_ImplGlfw_NewFrame();
     ImGui::NewFrame();
@@ -452,18 +1050,15 @@ void loop(GLFWwindow *window) {
     show_global_settings(mesh_set);
     show_model_matrix(mesh_set);
     show_lightning(mesh_set);
+    show_profiler(mesh_set);
+    if (ImGui::IsKeyPressed(ImGuiKey_K)) help = !help;
+    if (help) show_controls(&help);
+    profiler.end(STAGE_IMGUI_BUILD);
     
-    delta = glfwGetTime() - start_time;
-    total_time += delta;
-    if (delta < frame_time) {
-      double sleep_time = frame_time - delta;
-      std::this_thread::sleep_for(std::chrono::duration<double>(sleep_time));
-    }
+    profiler.begin(STAGE_INPUT);
     start_time = glfwGetTime();
 
-    
     quit = should_quit(window);
-    //glfwSwapInterval(1);
     glfwGetWindowSize(window, &width, &height);
   
     if (is_key_pressed(window, GLFW_KEY_LEFT)) {
@@ -501,12 +1096,19 @@ void loop(GLFWwindow *window) {
 	if (mesh_set->tex_mode == SPH) mesh_set->tex_mode = NO_TEX;
 	else mesh_set->tex_mode = SPH;
 	key_time = start_time;
+      } else if (is_key_pressed(window, GLFW_KEY_5) && mesh_set->has_texcoords) {
+	if (mesh_set->tex_mode == UV) mesh_set->tex_mode = NO_TEX;
+	else mesh_set->tex_mode = UV;
+	key_time = start_time;
+      } else if (is_key_pressed(window, GLFW_KEY_T) && !mesh_set->tex_layers.empty()) {
+	mesh_set->tex_layer = (mesh_set->tex_layer + 1) % (int)mesh_set->tex_layers.size();
+	key_time = start_time;
       }
     }
-    
-    glPolygonMode(GL_FRONT_AND_BACK, mesh_set->mode == FILL_POLYGON ? GL_FILL : GL_LINE);
 
-    if (is_mouse_button_pressed(window, GLFW_MOUSE_BUTTON_LEFT)) {
+    if (mesh_set->bench != nullptr) {
+      // --bench: o FrameBench arrasta o trackball, o mouse nao mexe no rotating
+    } else if (is_mouse_button_pressed(window, GLFW_MOUSE_BUTTON_LEFT)) {
       if (start_time - click_time > threshold) {
         click_time = start_time;
 	 //glClearColor(0.99, 0.3, 0.3, 1.0);
@@ -532,24 +1134,49 @@ void loop(GLFWwindow *window) {
       }
 
     }
+    profiler.end(STAGE_INPUT);
 
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glClearColor(mesh_set->bg_color[0], mesh_set->bg_color[1], mesh_set->bg_color[2], 1.0f);
-    glUseProgram(program);
-
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, tex);
-    
-    draw(VAO, program, mesh_set, get_mouse_pos(window));
+    if (mesh_set->bench == nullptr) mouse = get_mouse_pos(window);
+    render_frame(mesh_set, &rs, mouse, (float)glfwGetTime());
+    if (rs.stream_failed) quit = true;
 
-    if (ImGui::IsKeyPressed(ImGuiKey_K)) help = !help;
-    if (help) show_controls(&help);
-    
+    profiler.begin(STAGE_IMGUI_RENDER);
     ImGui::Render();
     ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+    profiler.end(STAGE_IMGUI_RENDER);
+    profiler.begin(STAGE_WAIT);
+    pacer.wait(mesh_set);
+    profiler.end(STAGE_WAIT);
+    profiler.begin(STAGE_SWAP);
     glfwSwapBuffers(window);
+    profiler.end(STAGE_SWAP);
+    pacer.frame_end(mesh_set);
+    if (mesh_set->bench != nullptr) {
+      mesh_set->bench->frame_end();
+      if (mesh_set->bench->done()) quit = true;
+    }
+    profiler.begin(STAGE_POLL);
     glfwPollEvents();
+    profiler.end(STAGE_POLL);
+    profiler.frame_end();
+
+    if (first_frame) {
+      first_frame = false;
+      std::cout << "primeiro frame: " << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - launch_time).count() << " ms" << std::endl;
+    }
+  }
+  if (mesh_set->bench != nullptr) {
+    mesh_set->bench->finish(mesh_set);
+    delete mesh_set->bench;
+    mesh_set->bench = nullptr;
   }
+  delete mesh_set->stream;
+  mesh_set->stream = nullptr;
+  delete rs.texture; // janela fechada antes da textura terminar
+  rs.texture = nullptr;
+  delete rs.layers;
+  rs.layers = nullptr;
+  mesh_set->profiler = nullptr;
   glfwDestroyCursor(cursor);
 
   ImGui_ImplOpenGL3_Shutdown();
@@ -557,11 +1184,110 @@ void loop(GLFWwindow *window) {
   ImGui::DestroyContext();
 }
 
+// --headless: um frame no FBO com o mesmo render_frame da janela, gravado em PNG
+void run_headless() {
+  HeadlessContext ctx;
+  Headless::create_context(&ctx);
+  std::cout << glGetString(GL_VERSION) << std::endl;
+  std::cout << glGetString(GL_RENDERER) << std::endl;
+
+  int width = (int)mesh_set->resolution.x;
+  int height = (int)mesh_set->resolution.y;
+  RenderTarget target;
+  Headless::create_target(width, height, HEADLESS_SAMPLES, &target);
+
+  RenderState rs;
+  rs.shared_tex = 0;
+  render_init(mesh_set, &rs);
+  texture_finish(&rs);
+  if (mesh_set->bench != nullptr) {
+    // sem swap: a CPU so espera quando o anel de queries enche
+    FrameBench *bench = mesh_set->bench;
+    bench->start();
+    while (!bench->done()) {
+      glm::vec2 mouse = bench->frame_begin(mesh_set);
+      render_frame(mesh_set, &rs, mouse, 0.0f);
+      bench->frame_end();
+    }
+    bench->finish(mesh_set);
+    delete bench;
+    mesh_set->bench = nullptr;
+  } else {
+    render_frame(mesh_set, &rs, glm::vec2(0.0f), 0.0f);
+  }
+
+  std::vector<uint8_t> rgba;
+  Headless::read_pixels(target, &rgba);
+  std::cout << "frame: " << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - launch_time).count() << " ms" << std::endl;
+  if (!PngWriter::write(mesh_set->output, width, height, rgba.data())) exit(1);
+  std::cout << "png escrito: " << mesh_set->output << " (" << width << "x" << height << ")" << std::endl;
+
+  Headless::destroy_target(&target);
+  Headless::destroy_context(&ctx);
+}
+
+// um contexto do --batch: desenha as malhas que o BatchRenderer entrega ate acabarem
+void render_batch(BatchRenderer *batch) {
+  HeadlessContext ctx;
+  Headless::create_context(&ctx);
+  RenderTarget target;
+  Headless::create_target(batch->opts.width, batch->opts.height, HEADLESS_SAMPLES, &target);
+
+  RenderState rs;
+  rs.shared_tex = 0;
+  BatchItem item;
+  std::vector<uint8_t> rgba;
+  while (batch->pop(&item)) {
+    MeshSettings *m = &item.mesh;
+    render_init(m, &rs);
+    texture_finish(&rs);
+    // a textura do --batch e uma so: decodifica e sobe uma vez por contexto
+    if (m->tex_file != nullptr) rs.shared_tex = rs.tex;
+    // volta completa em passos iguais sobre o quaternion do trackball
+    glm::quat start = m->rotation;
+    for (int f = 0; f < batch->frames; f++) {
+      float angle = 2.0f * (float)M_PI * f / batch->frames;
+      m->rotation = glm::normalize(glm::angleAxis(angle, glm::vec3(0.0f, 1.0f, 0.0f)) * start);
+      render_frame(m, &rs, glm::vec2(0.0f), 0.0f);
+      Headless::read_pixels(target, &rgba);
+      batch->encode(item.outputs[f], target.width, target.height, &rgba);
+    }
+    render_release(&rs);
+    MeshCache::unmap(m);
+  }
+  if (rs.shared_tex != 0) glDeleteTextures(1, &rs.shared_tex);
+
+  Headless::destroy_target(&target);
+  Headless::destroy_context(&ctx);
+}
+
+void run_batch() {
+  BatchRenderer *batch = mesh_set->batch;
+  batch->start();
+  std::vector<std::thread> renderers;
+  for (int c = 0; c < batch->opts.contexts; c++) renderers.push_back(std::thread(render_batch, batch));
+  for (size_t c = 0; c < renderers.size(); c++) renderers[c].join();
+  batch->finish();
+  delete batch;
+  mesh_set->batch = nullptr;
+}
+
 int main(int argc, char **argv) {
+  launch_time = std::chrono::steady_clock::now();
 
   MeshSettings m = ObjLoader::load_obj(argc, argv);
   mesh_set = (MeshSettings *) malloc(sizeof(MeshSettings));
   mesh_set = &m;
+
+  if (mesh_set->batch != nullptr) {
+    run_batch();
+    return 0;
+  }
+  if (mesh_set->output != nullptr) {
+    run_headless();
+    MeshCache::unmap(mesh_set);
+    return 0;
+  }
   
   if (!glfwInit()) {
     std::cerr << "Could not initialize glfw!" << std::endl;
@@ -601,11 +1327,9 @@ int main(int argc, char **argv) {
   std::cout << glGetString(GL_RENDERER) << std::endl;
   std::cout << glGetString(GL_SHADING_LANGUAGE_VERSION) << std::endl;
   
-  glEnable(GL_BLEND);
-  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-  
   loop(window);
 
+  MeshCache::unmap(mesh_set);
   glfwTerminate();
   return 0;
 }
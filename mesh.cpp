@@ -1,4 +1,8 @@
 #include "mesh.hpp"
+#include "instance.hpp"
+#include "profiler.hpp"
+#include <cstdio>
+#include <algorithm>
 #include "./dependencies/imgui/imgui.h"
 #include "imgui_impl_glfw.h"
 #include "imgui_impl_opengl3.h"
@@ -31,6 +35,11 @@ void show_global_info(MeshSettings *mesh_set) {
       ImGui::Text("%.3f ms/frame (%.1f FPS)", 1000.f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
       ImGui::Text("width %.1f height %.1f", mesh_set->resolution.x, mesh_set->resolution.y);
       ImGui::Separator();
+      static const char *pacing_modes[] = { "vsync", "limite de fps", "sem limite" };
+      ImGui::Combo("ritmo", &mesh_set->pacing_mode, pacing_modes, 3);
+      if (mesh_set->pacing_mode == PACING_LIMIT) ImGui::InputInt("fps alvo", &mesh_set->target_fps);
+      ImGui::Text("frame %.2f ms, jitter %.2f ms, pior %.2f ms", mesh_set->pacing.frame_ms, mesh_set->pacing.jitter_ms, mesh_set->pacing.worst_ms);
+      ImGui::Separator();
       if (ImGui::IsMousePosValid())
 	ImGui::Text("Posição do mouse: (%.1f,%.1f)", io.MousePos.x, io.MousePos.y);
       else
@@ -56,7 +65,12 @@ void show_global_settings(MeshSettings *mesh_set) {
   
   if (ImGui::Begin("mesh", nullptr, window_flags)) {
     ImGui::Text("malha: %s", mesh_set->obj_file);
-    ImGui::Text("textura: %s", mesh_set->tex_file);
+    if (!mesh_set->tex_layers.empty()) {
+      // as camadas ja estao na GPU, a troca e so o uniform v_layer
+      ImGui::Combo("textura (t)", &mesh_set->tex_layer, mesh_set->tex_layers.data(), (int)mesh_set->tex_layers.size());
+    } else {
+      ImGui::Text("textura: %s", mesh_set->tex_file);
+    }
     ImGui::Text("modo de visualização (v): %s", mesh_set->mode == FILL_POLYGON ? "fill polygon" : "polygon wireframe");
     ImGui::Text("luz (1): %s", mesh_set->light ? "ligada" : "desligada");
     switch (mesh_set->tex_mode) {
@@ -69,15 +83,39 @@ void show_global_settings(MeshSettings *mesh_set) {
     case SPH:
       ImGui::Text("modo de textura: %s", "esférica");
       break;
+    case UV:
+      ImGui::Text("modo de textura: %s", "coordenadas do arquivo");
+      break;
     case NO_TEX:
     default:
       ImGui::Text("modo de textura: %s", "sem textura");
     }
 
     ImGui::Separator();
+    if (mesh_set->stream != nullptr) ImGui::Text("carregando...");
     ImGui::Text("vertices: %lu", mesh_set->t_verts);
-    ImGui::Text("indices: %lu", mesh_set->t_index);
-    ImGui::Text("triangulos: %lu", mesh_set->t_index / 3);
+    ImGui::Text("indices: %lu", mesh_base_index_count(mesh_set));
+    ImGui::Text("triangulos: %lu", mesh_base_index_count(mesh_set) / 3);
+    if (!mesh_set->lods.empty()) {
+      ImGui::Text("LOD: %d (%lu triangulos)", mesh_set->lod, mesh_set->lods[mesh_set->lod].count / 3);
+      ImGui::SliderInt("forcar LOD (-1 automatico)", &mesh_set->forced_lod, -1, (int)mesh_set->lods.size() - 1);
+    }
+    if (!mesh_set->parts.empty()) {
+      ImGui::Text("partes: %lu (%u desenhadas)", mesh_set->parts.size(), mesh_set->visible_parts);
+      ImGui::Text("desenhados: %lu triangulos", mesh_set->visible_index / 3);
+      ImGui::Checkbox("culling de frustum", &mesh_set->cull_frustum);
+    }
+    if (!mesh_set->meshlets.empty()) {
+      ImGui::Text("meshlets: %lu", mesh_set->meshlets.size());
+      ImGui::Text("desenhados: %lu triangulos", mesh_set->visible_index / 3);
+      ImGui::Checkbox("culling de frustum", &mesh_set->cull_frustum);
+      ImGui::Checkbox("culling de costas (cone)", &mesh_set->cull_cone);
+    }
+    if (mesh_set->cache_before.acmr > 0.0f) {
+      ImGui::Separator();
+      ImGui::Text("ACMR: %.3f -> %.3f", mesh_set->cache_before.acmr, mesh_set->cache_after.acmr);
+      ImGui::Text("ATVR: %.3f -> %.3f", mesh_set->cache_before.atvr, mesh_set->cache_after.atvr);
+    }
 
     if (ImGui::BeginPopupContextWindow()) {
       if (ImGui::MenuItem("trocar modo de visualização (v)", NULL, menu_item == 1)) {
@@ -98,6 +136,10 @@ void show_global_settings(MeshSettings *mesh_set) {
 	menu_item = 0;
 	if (mesh_set->tex_mode == NO_TEX) mesh_set->tex_mode = SPH;
 	else mesh_set->tex_mode = NO_TEX;
+      } else if (ImGui::MenuItem("habilitar/desabilitar textura com coordenadas do arquivo (5)", NULL, menu_item == 6, mesh_set->has_texcoords)) {
+	menu_item = 0;
+	if (mesh_set->tex_mode == NO_TEX) mesh_set->tex_mode = UV;
+	else mesh_set->tex_mode = NO_TEX;
       }
       
       ImGui::EndPopup();
@@ -120,6 +162,12 @@ void show_model_matrix(MeshSettings *mesh_set) {
     ImGui::Separator();
     ImGui::InputFloat("stroke", &mesh_set->stroke);
     ImGui::SliderFloat("scale factor", &mesh_set->scale_factor, 0.01f, 1.0f);
+    ImGui::Separator();
+    // modo de estresse: N copias da malha num draw instanciado
+    static const char *layouts[] = { "grade", "aleatorio" };
+    ImGui::SliderInt("instancias", &mesh_set->instances, 1, INSTANCE_MAX);
+    ImGui::Combo("disposicao", &mesh_set->instance_layout, layouts, 2);
+    if (mesh_set->instances > 1) ImGui::Text("desenhados: %lu triangulos", mesh_set->visible_index / 3);
   }
   ImGui::End();
 }
@@ -131,14 +179,89 @@ void show_lightning(MeshSettings *mesh_set) {
   ImGui::SetNextWindowBgAlpha(0.35f); // Transparent background
   ImGui::Separator();
   ImGui::ColorEdit3("background color", &mesh_set->bg_color[0]);
-  ImGui::ColorEdit3("lightning color", &mesh_set->light_color[0]);
+  if (ImGui::ColorEdit3("lightning color", &mesh_set->light_color[0])) mesh_set->dirty |= DIRTY_LIGHT;
   ImGui::Separator();
-  ImGui::InputFloat3("lightning position", &mesh_set->light_position[0]);
+  if (ImGui::InputFloat3("lightning position", &mesh_set->light_position[0])) mesh_set->dirty |= DIRTY_LIGHT;
   ImGui::InputFloat3("camera position", &mesh_set->camera_position[0]);
-  ImGui::SliderFloat("ka (ambiente)", &mesh_set->ka, 0.0f, 1.0f);
-  ImGui::SliderFloat("kd (difusa)", &mesh_set->kd, 0.0f, 1.0f);
-  ImGui::SliderFloat("ks (especular)", &mesh_set->ks, 0.0f, 1.0f);
-  ImGui::InputFloat("atenuacao de brilho", &mesh_set->ksb);
+  if (ImGui::SliderFloat("ka (ambiente)", &mesh_set->ka, 0.0f, 1.0f)) mesh_set->dirty |= DIRTY_LIGHT;
+  if (ImGui::SliderFloat("kd (difusa)", &mesh_set->kd, 0.0f, 1.0f)) mesh_set->dirty |= DIRTY_LIGHT;
+  if (ImGui::SliderFloat("ks (especular)", &mesh_set->ks, 0.0f, 1.0f)) mesh_set->dirty |= DIRTY_LIGHT;
+  if (ImGui::InputFloat("atenuacao de brilho", &mesh_set->ksb)) mesh_set->dirty |= DIRTY_LIGHT;
+  ImGui::End();
+}
+
+void show_profiler(MeshSettings *mesh_set) {
+  const Profiler *profiler = mesh_set->profiler;
+  if (profiler == nullptr) return;
+  ImGui::SetNextWindowBgAlpha(0.35f); // Transparent background
+  if (ImGui::Begin("profiler", nullptr, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoNav)) {
+    uint32_t count = profiler->history_count();
+    float frame_avg = 0.0f, frame_max = 0.0f, gpu_avg = 0.0f;
+    uint32_t t_gpu = 0;
+    for (uint32_t i = 0; i < count; i++) {
+      frame_avg += profiler->frame_ms[i];
+      frame_max = std::max(frame_max, profiler->frame_ms[i]);
+      if (profiler->gpu_ms[i] >= 0.0f) {
+	gpu_avg += profiler->gpu_ms[i];
+	t_gpu++;
+      }
+    }
+    frame_avg = count ? frame_avg / count : 0.0f;
+    gpu_avg = t_gpu ? gpu_avg / t_gpu : 0.0f;
+
+    char overlay[64];
+    snprintf(overlay, sizeof(overlay), "media %.2f ms, max %.2f ms", frame_avg, frame_max);
+    ImGui::Text("frame (CPU), ultimos %u", count);
+    const ImVec2 graph_size = ImVec2(360.0f, 80.0f);
+    ImGui::PlotLines("##frame", profiler->frame_ms, count, profiler->history_offset(), overlay, 0.0f, frame_max * 1.2f, graph_size);
+
+    // picos: linha vermelha sobre o ponto do grafico
+    if (count > 1) {
+      ImVec2 pad = ImGui::GetStyle().FramePadding;
+      ImVec2 rect_min = ImGui::GetItemRectMin();
+      float x0 = rect_min.x + pad.x;
+      float width = graph_size.x - 2.0f * pad.x;
+      ImDrawList *draw_list = ImGui::GetWindowDrawList();
+      for (uint32_t k = 0; k < count; k++) {
+	if (!profiler->spike[(profiler->history_offset() + k) % PROFILER_HISTORY]) continue;
+	float x = x0 + width * k / (count - 1);
+	draw_list->AddLine(ImVec2(x, rect_min.y + pad.y), ImVec2(x, rect_min.y + graph_size.y - pad.y), IM_COL32(255, 60, 60, 255), 1.0f);
+      }
+    }
+    ImGui::Text("GPU do frame: %.2f ms (lido %d frames depois)", gpu_avg, PROFILER_LATENCY);
+
+    if (ImGui::BeginTable("etapas", 5, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingFixedFit)) {
+      ImGui::TableSetupColumn("etapa");
+      ImGui::TableSetupColumn("CPU media");
+      ImGui::TableSetupColumn("CPU max");
+      ImGui::TableSetupColumn("GPU media");
+      ImGui::TableSetupColumn("GPU max");
+      ImGui::TableHeadersRow();
+      for (int s = 0; s < STAGE_COUNT; s++) {
+	float cpu_avg, cpu_max, stage_gpu_avg, stage_gpu_max;
+	profiler->stage_stats(s, &cpu_avg, &cpu_max, &stage_gpu_avg, &stage_gpu_max);
+	ImGui::TableNextRow();
+	ImGui::TableNextColumn();
+	ImGui::TextUnformatted(Profiler::stage_name(s));
+	ImGui::TableNextColumn();
+	ImGui::Text("%.3f", cpu_avg);
+	ImGui::TableNextColumn();
+	ImGui::Text("%.3f", cpu_max);
+	ImGui::TableNextColumn();
+	if (stage_gpu_avg >= 0.0f) ImGui::Text("%.3f", stage_gpu_avg); else ImGui::TextUnformatted("-");
+	ImGui::TableNextColumn();
+	if (stage_gpu_max >= 0.0f) ImGui::Text("%.3f", stage_gpu_max); else ImGui::TextUnformatted("-");
+      }
+      ImGui::EndTable();
+    }
+
+    ImGui::Text("picos (> %.0fx a media): %u", PROFILER_SPIKE, profiler->t_spikes);
+    if (profiler->t_spikes > 0) {
+      ImGui::Text("ultimo: frame %lu, %.2f ms, mais tempo em %s", (unsigned long)profiler->last_spike, profiler->last_spike_ms,
+		  Profiler::stage_name(profiler->last_spike_stage));
+    }
+    if (profiler->dropped > 0) ImGui::Text("frames sem GPU (queries atrasadas): %u", profiler->dropped);
+  }
   ImGui::End();
 }
 
@@ -162,5 +285,7 @@ void show_controls(bool *p_open) {
   ImGui::BulletText("%s", TEX_ORTHO);
   ImGui::BulletText("%s", TEX_CIL);
   ImGui::BulletText("%s", TEX_SPH);
+  ImGui::BulletText("%s", TEX_UV);
+  ImGui::BulletText("%s", TEX_LAYER_KEY);
   ImGui::End();
 }
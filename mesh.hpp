@@ -4,6 +4,7 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 #include <vector>
+#include <string>
 
 #define MOUSE_ICON_FILE "mouse_icon.png"
 
@@ -22,6 +23,8 @@
 #define TEX_ORTHO "(2): habilita/desabilita o mapeamento de textura com projeção paralela sobre a imagem da textura."
 #define TEX_CIL "(3): habilita/desabilita o mapeamento de textura com coordenadas cilíndricas."
 #define TEX_SPH "(4): habilita/desabilita o mapeamento de textura com coordenadas esféricas."
+#define TEX_UV "(5): habilita/desabilita o mapeamento de textura com as coordenadas (vt) do arquivo."
+#define TEX_LAYER_KEY "(t): passa para a próxima textura do --texarray."
 #define K_KEY "(k): abre/fecha a tela de controles."
 #define KEYS "para ler novamente passe a opção -k ou acesse a tela de controles."
 
@@ -29,31 +32,135 @@ typedef struct {
   glm::vec4 position;
   glm::vec3 normal;
   glm::vec4 color;
+  glm::vec2 texcoord; // vt do arquivo, 0 quando ausente
 } Vertex;
 
+// cache binario mapeado com mmap, vertices/indices apontam para dentro do mapa
+typedef struct {
+  void *addr;
+  size_t size;
+  const Vertex *vertices;
+  const uint32_t *indices;
+} MappedMesh;
+
 enum VISUALIZATION_MODE {
   FILL_POLYGON,
   WIREFRAME,
 };
 
+enum PACING_MODE {
+  PACING_VSYNC = 0, // glfwSwapInterval(1)
+  PACING_LIMIT,     // fps alvo, sem vsync
+  PACING_UNCAPPED,  // sem vsync e sem espera, para medir
+};
+
+// estatisticas do FramePacer nos ultimos PACING_HISTORY frames
+typedef struct {
+  float frame_ms;  // media do intervalo entre frames
+  float jitter_ms; // desvio padrao do intervalo
+  float worst_ms;
+} PacingStats;
+
+// blocos de uniform que precisam ser reenviados
+enum DIRTY_FLAGS {
+  DIRTY_LIGHT = 1 << 0, // posicao e cor da luz, coeficientes do material
+};
+
 enum TEXTURE_MODE {
   NO_TEX = 0,
   ORTHO,
   CIL,
   SPH,
+  UV,
+};
+
+// formato da textura na GPU (--texfmt); os comprimidos vao para o cache .ktx2
+enum TEXTURE_FORMAT {
+  TEX_FORMAT_AUTO = 0, // BC1 se opaca, senao BC7 (ou BC3 sem BPTC)
+  TEX_FORMAT_NONE,     // sem compressao, canais do arquivo
+  TEX_FORMAT_BC1,
+  TEX_FORMAT_BC3,
+  TEX_FORMAT_BC7,
 };
 
+// faixa do index buffer de uma LOD, todas usam o mesmo VBO
+typedef struct {
+  uint64_t offset; // em indices
+  uint64_t count;
+} MeshLod;
+
+// faixa de ~124 triangulos da LOD0 com esfera envolvente e cone de normais (--meshlets)
+typedef struct {
+  uint32_t offset;      // em indices
+  uint32_t count;
+  float center[3];
+  float radius;
+  float cone_axis[3];
+  float cone_cutoff;    // seno da abertura do cone, 1 quando nao da para descartar
+} Meshlet;
+
+// parte de uma cena (--scene): faixas do VBO/EBO compartilhados, indices locais a parte
+typedef struct {
+  std::string obj_file;
+  uint64_t base_vertex;  // primeiro vertice da parte no VBO
+  uint64_t first_index;  // primeiro indice da parte no EBO
+  uint64_t t_index;
+  glm::mat4 transform;   // normalizado da parte -> normalizado da cena
+  glm::vec3 bbox_min;    // caixa no espaco normalizado da parte
+  glm::vec3 bbox_max;
+} MeshPart;
+
+// vertices transformados por triangulo (ACMR) e por vertice unico (ATVR)
+typedef struct {
+  float acmr;
+  float atvr;
+} VertexCacheStats;
+
+class StreamLoader;
+class BatchRenderer;
+class FrameBench;
+class Profiler;
+
 typedef struct {
   const char *obj_file;
   const char *tex_file;
+  const char *output;   // PNG do --headless, nullptr com janela
   glm::vec2 resolution; 
   VISUALIZATION_MODE mode;
   TEXTURE_MODE tex_mode;
+  TEXTURE_FORMAT tex_format; // --texfmt
+  bool tex_cache;            // le e grava o .ktx2 da textura
+  std::vector<const char *> tex_layers; // --texarray, vazio com uma textura so
+  int tex_layer;                        // camada amostrada do GL_TEXTURE_2D_ARRAY
   std::vector<Vertex> vertices;
   uint64_t t_verts;
   std::vector<uint32_t> indices;
-  uint64_t t_index;
+  uint64_t t_index;   // todos os indices do EBO, LODs inclusas
+  std::vector<MeshLod> lods; // vazio sem --lod, lods[0] e a malha completa
+  int lod;            // LOD desenhada no ultimo frame
+  int forced_lod;     // -1: escolhe pelo tamanho na tela
+  std::vector<Meshlet> meshlets; // vazio sem --meshlets, cobrem lods[0]
+  bool cull_frustum;
+  bool cull_cone;
+  uint64_t visible_index; // indices desenhados no ultimo frame
+  std::vector<MeshPart> parts; // vazio fora do --scene
+  uint32_t visible_parts;
+  int instances;       // copias desenhadas com glDrawElementsInstanced, 1 desliga
+  int instance_layout; // INSTANCE_LAYOUT
+  bool has_texcoords;
+  bool compact;       // --compact: CompactVertex no VBO, decodificado no vertex shader
+  bool short_indices; // EBO com indices de 16 bits (so no --compact, t_verts < 65536)
+  VertexCacheStats cache_before; // antes do --optimize, zerado quando veio do cache
+  VertexCacheStats cache_after;
+  MappedMesh mapped;
+  StreamLoader *stream; // carregamento em andamento (--stream), nullptr com a malha completa
+  BatchRenderer *batch; // --batch, nullptr com uma malha so
+  FrameBench *bench;    // --bench em andamento, nullptr sem medir
+  Profiler *profiler;   // etapas do frame na janela, nullptr no --headless
   glm::vec3 center;
+  float escala;       // normalizado = (original - center) * escala
+  glm::vec3 bbox_min; // caixa envolvente ja normalizada
+  glm::vec3 bbox_max;
   glm::vec2 mouse_pos;
   bool rotating;
   glm::quat rotation;
@@ -71,12 +178,31 @@ typedef struct {
   float kd;
   float ks;
   float ksb;
+  uint32_t dirty;     // DIRTY_FLAGS, limpo no upload do draw
+  int pacing_mode;    // PACING_MODE
+  int target_fps;     // alvo do PACING_LIMIT
+  PacingStats pacing;
 } MeshSettings;
 
+// dados prontos para o upload: do cache mapeado ou dos vetores
+inline const Vertex *mesh_vertex_data(const MeshSettings *mesh_set) {
+  return mesh_set->mapped.addr ? mesh_set->mapped.vertices : mesh_set->vertices.data();
+}
+
+inline const uint32_t *mesh_index_data(const MeshSettings *mesh_set) {
+  return mesh_set->mapped.addr ? mesh_set->mapped.indices : mesh_set->indices.data();
+}
+
+// indices da malha completa (sem as LODs)
+inline uint64_t mesh_base_index_count(const MeshSettings *mesh_set) {
+  return mesh_set->lods.empty() ? mesh_set->t_index : mesh_set->lods[0].count;
+}
+
 void show_global_info(MeshSettings *mesh_set);
 void show_global_settings(MeshSettings *mesh_set);
 void show_model_matrix(MeshSettings *mesh_set);
 void show_lightning(MeshSettings *mesh_set);
+void show_profiler(MeshSettings *mesh_set);
 void show_controls(bool *p_open);
 
 #endif /* MESH_H */
@@ -0,0 +1,203 @@
+#include "meshlet.hpp"
+#include "simplify.hpp"
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+
+#define NO_MESHLET 0xFFFFFFFFu
+
+static glm::vec3 triangle_normal(const std::vector<Vertex> &verts, const uint32_t *tri) {
+  glm::vec3 p0 = glm::vec3(verts[tri[0]].position);
+  glm::vec3 p1 = glm::vec3(verts[tri[1]].position);
+  glm::vec3 p2 = glm::vec3(verts[tri[2]].position);
+  glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+  float len = glm::length(n);
+  return len > 0.0f ? n / len : glm::vec3(0.0f);
+}
+
+static void meshlet_bounds(const uint32_t *tris, uint32_t count, const std::vector<Vertex> &verts, Meshlet *m) {
+  // esfera: centro da caixa dos vertices, raio ate o mais distante
+  glm::vec3 bmin = glm::vec3(FLT_MAX);
+  glm::vec3 bmax = glm::vec3(-FLT_MAX);
+  for (uint32_t i = 0; i < count; i++) {
+    glm::vec3 p = glm::vec3(verts[tris[i]].position);
+    bmin = glm::min(bmin, p);
+    bmax = glm::max(bmax, p);
+  }
+  glm::vec3 center = (bmin + bmax) / 2.0f;
+  float radius = 0.0f;
+  for (uint32_t i = 0; i < count; i++) radius = std::max(radius, glm::length(glm::vec3(verts[tris[i]].position) - center));
+
+  // cone: eixo na media das normais, abertura pela normal mais afastada do eixo
+  glm::vec3 axis = glm::vec3(0.0f);
+  for (uint32_t t = 0; t < count / 3; t++) axis += triangle_normal(verts, &tris[3 * t]);
+  float len = glm::length(axis);
+  float min_dot = -1.0f;
+  if (len > 0.0f) {
+    axis /= len;
+    min_dot = 1.0f;
+    for (uint32_t t = 0; t < count / 3; t++) {
+      glm::vec3 n = triangle_normal(verts, &tris[3 * t]);
+      if (n != glm::vec3(0.0f)) min_dot = std::min(min_dot, glm::dot(n, axis));
+    }
+  }
+
+  for (int k = 0; k < 3; k++) {
+    m->center[k] = center[k];
+    m->cone_axis[k] = axis[k];
+  }
+  m->radius = radius;
+  // seno da abertura; 1 quando o cone passa de 90 graus e nunca da para descartar
+  m->cone_cutoff = min_dot <= 0.0f ? 1.0f : sqrtf(1.0f - min_dot * min_dot);
+}
+
+void MeshletBuilder::build(std::vector<uint32_t> *indices, size_t t_index, const std::vector<Vertex> &verts,
+			   std::vector<Meshlet> *meshlets) {
+  const uint32_t *in = indices->data();
+  size_t t_tris = t_index / 3;
+  size_t t_verts = verts.size();
+  meshlets->clear();
+  if (t_tris == 0) return;
+
+  // vizinhanca por posicao, senao malhas com normais por face nao tem arestas em comum
+  std::vector<uint32_t> pos_id;
+  MeshSimplifier::position_ids(verts, &pos_id);
+  std::vector<uint32_t> offsets(t_verts + 1, 0);
+  for (size_t i = 0; i < t_tris * 3; i++) offsets[pos_id[in[i]] + 1]++;
+  for (size_t v = 0; v < t_verts; v++) offsets[v + 1] += offsets[v];
+  std::vector<uint32_t> adjacency(t_tris * 3);
+  {
+    std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < t_tris * 3; i++) adjacency[cursor[pos_id[in[i]]]++] = (uint32_t)(i / 3);
+  }
+
+  std::vector<glm::vec3> normals(t_tris);
+  for (size_t t = 0; t < t_tris; t++) normals[t] = triangle_normal(verts, &in[3 * t]);
+
+  std::vector<uint8_t> emitted(t_tris, 0);
+  std::vector<uint32_t> tri_mark(t_tris, NO_MESHLET);   // ja e candidato do meshlet atual
+  std::vector<uint32_t> vert_mark(t_verts, NO_MESHLET); // posicao ja usada pelo meshlet atual
+  std::vector<uint32_t> candidates;
+  std::vector<uint32_t> out;
+  out.reserve(t_tris * 3);
+  size_t seed = 0;
+
+  while (out.size() < t_tris * 3) {
+    while (emitted[seed]) seed++;
+    uint32_t id = (uint32_t)meshlets->size();
+    size_t first = out.size();
+    glm::vec3 axis = glm::vec3(0.0f);
+    uint32_t count = 0;
+    uint32_t t = (uint32_t)seed;
+    candidates.clear();
+
+    // cresce pela vizinhanca ate MESHLET_MAX_TRIANGLES ou acabar a ilha
+    while (true) {
+      emitted[t] = 1;
+      count++;
+      out.insert(out.end(), &in[3 * t], &in[3 * t + 3]);
+      axis += normals[t];
+      for (int c = 0; c < 3; c++) {
+	uint32_t p = pos_id[in[3 * t + c]];
+	if (vert_mark[p] == id) continue;
+	vert_mark[p] = id;
+	for (uint32_t a = offsets[p]; a < offsets[p + 1]; a++) {
+	  uint32_t u = adjacency[a];
+	  if (!emitted[u] && tri_mark[u] != id) {
+	    tri_mark[u] = id;
+	    candidates.push_back(u);
+	  }
+	}
+      }
+      if (count == MESHLET_MAX_TRIANGLES) break;
+
+      // o candidato que mais compartilha posicoes, desempata pela normal (cone mais fechado)
+      float len = glm::length(axis);
+      glm::vec3 dir = len > 0.0f ? axis / len : axis;
+      float best_score = -FLT_MAX;
+      size_t best = 0;
+      size_t kept = 0;
+      for (size_t k = 0; k < candidates.size(); k++) {
+	uint32_t u = candidates[k];
+	if (emitted[u]) continue;
+	candidates[kept] = u;
+	int shared = 0;
+	for (int c = 0; c < 3; c++) shared += vert_mark[pos_id[in[3 * u + c]]] == id;
+	float score = (float)shared + 0.5f * glm::dot(normals[u], dir);
+	if (score > best_score) {
+	  best_score = score;
+	  best = kept;
+	}
+	kept++;
+      }
+      candidates.resize(kept);
+      if (candidates.empty()) break;
+      t = candidates[best];
+    }
+
+    Meshlet m;
+    m.offset = (uint32_t)first;
+    m.count = (uint32_t)(out.size() - first);
+    meshlet_bounds(&out[first], m.count, verts, &m);
+    meshlets->push_back(m);
+  }
+  std::copy(out.begin(), out.end(), indices->begin());
+}
+
+// linhas da mvp (Gribb/Hartmann), ja no espaco do modelo
+void MeshletBuilder::frustum_planes(const glm::mat4 &mvp, glm::vec4 planes[6]) {
+  glm::vec4 rows[4];
+  for (int i = 0; i < 4; i++) rows[i] = glm::vec4(mvp[0][i], mvp[1][i], mvp[2][i], mvp[3][i]);
+  planes[0] = rows[3] + rows[0];
+  planes[1] = rows[3] - rows[0];
+  planes[2] = rows[3] + rows[1];
+  planes[3] = rows[3] - rows[1];
+  planes[4] = rows[3] + rows[2];
+  planes[5] = rows[3] - rows[2];
+}
+
+bool MeshletBuilder::sphere_outside(const glm::vec4 planes[6], glm::vec3 center, float radius) {
+  for (int p = 0; p < 6; p++) {
+    glm::vec3 n = glm::vec3(planes[p]);
+    if (glm::dot(n, center) + planes[p].w < -radius * glm::length(n)) return true;
+  }
+  return false;
+}
+
+uint64_t MeshletBuilder::cull(const std::vector<Meshlet> &meshlets, const glm::mat4 &mvp, glm::vec3 camera,
+			      bool frustum, bool cone, uint32_t index_size,
+			      std::vector<int32_t> *counts, std::vector<const void *> *offsets) {
+  counts->clear();
+  offsets->clear();
+
+  glm::vec4 planes[6];
+  MeshletBuilder::frustum_planes(mvp, planes);
+
+  uint64_t visible = 0;
+  uint64_t range_end = 0;
+  for (size_t i = 0; i < meshlets.size(); i++) {
+    const Meshlet &m = meshlets[i];
+    glm::vec3 center = glm::vec3(m.center[0], m.center[1], m.center[2]);
+
+    if (frustum && MeshletBuilder::sphere_outside(planes, center, m.radius)) continue;
+
+    if (cone && m.cone_cutoff < 1.0f) {
+      // todos os triangulos de costas para a camera
+      glm::vec3 d = center - camera;
+      glm::vec3 axis = glm::vec3(m.cone_axis[0], m.cone_axis[1], m.cone_axis[2]);
+      if (glm::dot(d, axis) >= m.cone_cutoff * glm::length(d) + m.radius) continue;
+    }
+
+    // meshlets vizinhos no index buffer viram uma faixa so
+    uint64_t begin = (uint64_t)m.offset * index_size;
+    if (!counts->empty() && range_end == begin) {
+      counts->back() += (int32_t)m.count;
+    } else {
+      counts->push_back((int32_t)m.count);
+      offsets->push_back((const void *)(uintptr_t)begin);
+    }
+    range_end = begin + (uint64_t)m.count * index_size;
+    visible += m.count;
+  }
+  return visible;
+}
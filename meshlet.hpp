@@ -0,0 +1,26 @@
+#ifndef MESHLET_H
+#define MESHLET_H
+
+#include "mesh.hpp"
+
+#define MESHLET_MAX_TRIANGLES 124
+
+// divisao da malha completa (lods[0]) em meshlets contiguos no index buffer,
+// cada um com esfera envolvente e cone de normais para o culling na CPU
+class MeshletBuilder
+{
+public:
+  // reordena indices[0..t_index) para que cada meshlet seja uma faixa contigua
+  static void build(std::vector<uint32_t> *indices, size_t t_index, const std::vector<Vertex> &verts,
+		    std::vector<Meshlet> *meshlets);
+  // planos do frustum no espaco em que mvp comeca, normal nao normalizada
+  static void frustum_planes(const glm::mat4 &mvp, glm::vec4 planes[6]);
+  static bool sphere_outside(const glm::vec4 planes[6], glm::vec3 center, float radius);
+  // mvp e camera no espaco do modelo; preenche as faixas visiveis (contadores e
+  // offsets em bytes para glMultiDrawElements) e retorna quantos indices sobraram
+  static uint64_t cull(const std::vector<Meshlet> &meshlets, const glm::mat4 &mvp, glm::vec3 camera,
+		       bool frustum, bool cone, uint32_t index_size,
+		       std::vector<int32_t> *counts, std::vector<const void *> *offsets);
+};
+
+#endif /* MESHLET_H */
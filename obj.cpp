@@ -1,4 +1,13 @@
 #include "obj.hpp"
+#include "cache.hpp"
+#include "stream.hpp"
+#include "optimize.hpp"
+#include "simplify.hpp"
+#include "meshlet.hpp"
+#include "scene.hpp"
+#include "batch.hpp"
+#include "framebench.hpp"
+#include "texture.hpp"
 #include <vector>
 #include <iostream>
 #include <glm/ext/matrix_transform.hpp> // glm::translate, glm::rotate, glm::scale
@@ -6,12 +15,328 @@
 #include <glm/gtx/string_cast.hpp>
 #include <glm/ext/matrix_transform.hpp>
 #include <float.h>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+#include "parallel.hpp"
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
 
 
 #define TINYOBJLOADER_IMPLEMENTATION // define this in only *one* .cc
 #include "tiny_obj_loader.h"
 
+#define EMPTY_SLOT 0xFFFFFFFFu
+#define POST_GRAIN 65536 // itens minimos por thread nos passos depois do dedupe
+
+// tabela hash de enderecamento aberto (linear probing) que mapea
+// o triplo (posicao, normal, texcoord) do tiny -> index do verts. Os baldes
+// guardam so o index de 32 bits; a chave fica uma vez por vertice em keys
+#define VERTEX_TABLE_LOAD 0.7 // cresce acima dessa ocupacao
+
+class VertexTable
+{
+public:
+  // expected: vertices unicos esperados (as posicoes do arquivo), cresce se passar
+  VertexTable(size_t expected) {
+    size_t cap = 16;
+    while (cap < expected * 2) cap <<= 1;
+    mask = cap - 1;
+    slots.assign(cap, EMPTY_SLOT);
+    keys.reserve(expected);
+  }
+
+  // index do vertice da chave; se a chave e nova ela vira o vertice keys.size()
+  // e retorna EMPTY_SLOT, o chamador empilha o vertice na mesma ordem
+  uint32_t find_or_insert(const ObjIndex &idx) {
+    if (keys.size() + 1 > (size_t)(VERTEX_TABLE_LOAD * (mask + 1))) grow();
+    size_t h = hash(idx) & mask;
+    while (slots[h] != EMPTY_SLOT) {
+      const ObjIndex &k = keys[slots[h]];
+      if (k.vertex_index == idx.vertex_index && k.normal_index == idx.normal_index && k.texcoord_index == idx.texcoord_index) {
+	return slots[h];
+      }
+      h = (h + 1) & mask;
+    }
+    slots[h] = (uint32_t)keys.size();
+    keys.push_back(idx);
+    return EMPTY_SLOT;
+  }
+
+private:
+  static size_t hash(const ObjIndex &idx) {
+    uint64_t h = (uint32_t)idx.vertex_index * 0x9E3779B97F4A7C15ull;
+    h ^= ((uint32_t)idx.normal_index + 0x632BE59BD9B4E019ull) * 0xC2B2AE3D27D4EB4Full;
+    h ^= ((uint32_t)idx.texcoord_index + 0x85EBCA77C2B2AE63ull) * 0x165667B19E3779F9ull;
+    return (size_t)(h ^ (h >> 29));
+  }
+
+  // dobra e reinsere os indices, as chaves nao mudam de lugar
+  void grow() {
+    mask = mask * 2 + 1;
+    slots.assign(mask + 1, EMPTY_SLOT);
+    for (uint32_t v = 0; v < (uint32_t)keys.size(); v++) {
+      size_t h = hash(keys[v]) & mask;
+      while (slots[h] != EMPTY_SLOT) h = (h + 1) & mask;
+      slots[h] = v;
+    }
+  }
+
+  size_t mask;
+  std::vector<uint32_t> slots;
+  std::vector<ObjIndex> keys; // chave de cada vertice, na ordem do verts
+};
+
+static double elapsed_ms(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// remove as opcoes longas (--opcao) do argv, o resto segue posicional
+static bool ends_with(const char *s, const char *ext) {
+  size_t len = strlen(s), ext_len = strlen(ext);
+  return len >= ext_len && strcmp(s + len - ext_len, ext) == 0;
+}
+
+// texturas que o stb_image le no --convert e no fim do --scene
+static bool is_image(const char *s) {
+  return ends_with(s, ".png") || ends_with(s, ".jpg") || ends_with(s, ".jpeg");
+}
+
+// opcoes que mudam o que vai para o .mesh2cache
+static uint32_t cache_flags(const LoadOptions &opts) {
+  uint32_t flags = 0;
+  if (opts.lod) flags |= MESH_CACHE_LOD;
+  if (opts.optimize) flags |= MESH_CACHE_OPTIMIZE;
+  if (opts.overdraw) flags |= MESH_CACHE_OVERDRAW;
+  if (opts.meshlets) flags |= MESH_CACHE_MESHLETS;
+  return flags;
+}
+
+static int take_options(int argc, char **argv, LoadOptions *opts) {
+  int n = 1;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--tinyobj") == 0) {
+      opts->tinyobj = true;
+    } else if (strcmp(argv[i], "--convert") == 0) {
+      opts->convert = true;
+    } else if (strcmp(argv[i], "--optimize") == 0) {
+      opts->optimize = true;
+    } else if (strcmp(argv[i], "--overdraw") == 0) {
+      opts->optimize = true;
+      opts->overdraw = true;
+    } else if (strcmp(argv[i], "--lod") == 0) {
+      opts->lod = true;
+    } else if (strcmp(argv[i], "--meshlets") == 0) {
+      opts->meshlets = true;
+    } else if (strcmp(argv[i], "--scene") == 0) {
+      opts->scene = true;
+    } else if (strcmp(argv[i], "--compact") == 0) {
+      opts->compact = true;
+    } else if (strcmp(argv[i], "--stream") == 0) {
+      opts->stream = true;
+    } else if (strcmp(argv[i], "--vsync") == 0) {
+      opts->pacing = PACING_VSYNC;
+    } else if (strcmp(argv[i], "--uncapped") == 0) {
+      opts->pacing = PACING_UNCAPPED;
+    } else if (strcmp(argv[i], "--fps") == 0) {
+      if (i + 1 >= argc || atoi(argv[i + 1]) <= 0) {
+	std::cerr << "--fps espera o numero de frames por segundo." << std::endl;
+	exit(1);
+      }
+      opts->pacing = PACING_LIMIT;
+      opts->target_fps = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--headless") == 0) {
+      opts->headless = true;
+    } else if (strcmp(argv[i], "--out") == 0) {
+      if (i + 1 >= argc) {
+	std::cerr << "--out espera o caminho do PNG." << std::endl;
+	exit(1);
+      }
+      opts->output = argv[++i];
+    } else if (strcmp(argv[i], "--size") == 0) {
+      if (i + 1 >= argc || sscanf(argv[i + 1], "%dx%d", &opts->width, &opts->height) != 2 || opts->width <= 0 || opts->height <= 0) {
+	std::cerr << "--size espera LARGURAxALTURA, por exemplo 1920x1080." << std::endl;
+	exit(1);
+      }
+      i++;
+    } else if (strcmp(argv[i], "--tex") == 0) {
+      const char *modes[] = { "none", "ortho", "cil", "sph", "uv" };
+      opts->tex_mode = -1;
+      for (int m = 0; m < 5 && i + 1 < argc; m++) if (strcmp(argv[i + 1], modes[m]) == 0) opts->tex_mode = m;
+      if (opts->tex_mode < 0) {
+	std::cerr << "--tex espera ortho, cil, sph ou uv." << std::endl;
+	exit(1);
+      }
+      i++;
+    } else if (strcmp(argv[i], "--texfmt") == 0) {
+      const char *formats[] = { "auto", "none", "bc1", "bc3", "bc7" };
+      opts->tex_format = -1;
+      for (int f = 0; f < 5 && i + 1 < argc; f++) if (strcmp(argv[i + 1], formats[f]) == 0) opts->tex_format = f;
+      if (opts->tex_format < 0) {
+	std::cerr << "--texfmt espera auto, none, bc1, bc3 ou bc7." << std::endl;
+	exit(1);
+      }
+      i++;
+    } else if (strcmp(argv[i], "--texarray") == 0) {
+      opts->tex_array = true;
+    } else if (strcmp(argv[i], "--batch") == 0) {
+      opts->batch = true;
+    } else if (strcmp(argv[i], "--turntable") == 0) {
+      opts->batch = true;
+      opts->turntable = true;
+    } else if (strcmp(argv[i], "--loaders") == 0) {
+      if (i + 1 >= argc || atoi(argv[i + 1]) <= 0) {
+	std::cerr << "--loaders espera o numero de threads de parse." << std::endl;
+	exit(1);
+      }
+      opts->loaders = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--contexts") == 0) {
+      if (i + 1 >= argc || atoi(argv[i + 1]) <= 0) {
+	std::cerr << "--contexts espera o numero de contextos GL." << std::endl;
+	exit(1);
+      }
+      opts->contexts = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--bench") == 0) {
+      if (i + 1 >= argc || atof(argv[i + 1]) <= 0.0) {
+	std::cerr << "--bench espera a duracao em segundos." << std::endl;
+	exit(1);
+      }
+      opts->bench = (float)atof(argv[++i]);
+    } else if (strcmp(argv[i], "--csv") == 0) {
+      if (i + 1 >= argc) {
+	std::cerr << "--csv espera o caminho do arquivo." << std::endl;
+	exit(1);
+      }
+      opts->csv = argv[++i];
+    } else if (strcmp(argv[i], "--no-cache") == 0) {
+      opts->use_cache = false;
+    } else if (strncmp(argv[i], "--", 2) == 0) {
+      std::cerr << "opção desconhecida: " << argv[i] << std::endl;
+      exit(1);
+    } else {
+      argv[n++] = argv[i];
+    }
+  }
+  argv[n] = NULL;
+  return n;
+}
+
+bool ObjLoader::parse(const char *path, const LoadOptions &opts, ObjData *data) {
+  if (!opts.tinyobj) {
+    std::string err;
+    if (!ObjParser::parse_file(path, data, &err)) {
+      std::cerr << "ObjParser: " << err << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  // parser de referencia
+  tinyobj::ObjReaderConfig reader_config;
+  reader_config.mtl_search_path = "./models/"; // Path to material files
+
+  tinyobj::ObjReader reader;
+
+  if (!reader.ParseFromFile(path, reader_config)) {
+    if (!reader.Error().empty()) {
+      std::cerr << "TinyObjReader: " << reader.Error();
+    }
+    return false;
+  }
+
+  if (!reader.Warning().empty()) {
+    std::cout << "TinyObjReader: " << reader.Warning();
+  }
+
+  auto& attrib = reader.GetAttrib();
+  auto& shapes = reader.GetShapes();
+
+  data->vertices = attrib.vertices;
+  data->normals = attrib.normals;
+  data->texcoords = attrib.texcoords;
+  for (uint32_t s = 0; s < shapes.size(); s++) {
+    for (uint32_t i = 0; i < shapes[s].mesh.indices.size(); i++) {
+      const tinyobj::index_t &idx = shapes[s].mesh.indices[i];
+      data->indices.push_back((ObjIndex){ idx.vertex_index, idx.normal_index, idx.texcoord_index });
+    }
+  }
+  return true;
+}
+
+MeshSettings ObjLoader::make_settings(const char *obj_file, const char *tex_file) {
+  return (MeshSettings){
+    .obj_file = obj_file,
+    .tex_file = tex_file,
+    .output = nullptr,
+    .resolution = glm::vec2(WIDTH, HEIGHT),
+    .mode = FILL_POLYGON,
+    .tex_mode = NO_TEX,
+    .tex_format = TEX_FORMAT_AUTO,
+    .tex_cache = true,
+    .tex_layers = std::vector<const char *>(),
+    .tex_layer = 0,
+    .vertices = std::vector<Vertex>(),
+    .t_verts = 0,
+    .indices = std::vector<uint32_t>(),
+    .t_index = 0,
+    .lods = std::vector<MeshLod>(),
+    .lod = 0,
+    .forced_lod = -1,
+    .meshlets = std::vector<Meshlet>(),
+    .cull_frustum = true,
+    .cull_cone = true,
+    .visible_index = 0,
+    .parts = std::vector<MeshPart>(),
+    .visible_parts = 0,
+    .instances = 1,
+    .instance_layout = 0,
+    .has_texcoords = false,
+    .compact = false,
+    .short_indices = false,
+    .cache_before = (VertexCacheStats){ .acmr = 0.0f, .atvr = 0.0f },
+    .cache_after = (VertexCacheStats){ .acmr = 0.0f, .atvr = 0.0f },
+    .mapped = (MappedMesh){ .addr = nullptr, .size = 0, .vertices = nullptr, .indices = nullptr },
+    .stream = nullptr,
+    .batch = nullptr,
+    .bench = nullptr,
+    .profiler = nullptr,
+    .center = glm::vec3(0.0f),
+    .escala = 1.0f,
+    .bbox_min = glm::vec3(0.0f),
+    .bbox_max = glm::vec3(0.0f),
+    .mouse_pos = glm::vec2(0.0f),
+    .rotating = false,
+    .rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f),
+    .translate = glm::vec3(0.0f),
+    .scale = glm::vec3(1.0f),
+    .scale_factor = 0.01f,
+    .color = glm::vec4(0.466f, 0.363f, 0.755f, 1.0f),
+    .bg_color = glm::vec4(0.150f, 0.151f, 0.167f, 1.000f),
+    .stroke = 1.0f,
+    .light = false,
+    .camera_position = glm::vec3(0.0f, 0.0f, 3.0f),
+    .light_position = glm::vec3(1.0f, 0.0f, 2.0f),
+    .light_color = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f),
+    .ka = 0.5f,
+    .kd = 0.8f,
+    .ks = 1.0f,
+    .ksb = 3.0f,
+    .dirty = DIRTY_LIGHT,
+    .pacing_mode = PACING_VSYNC,
+    .target_fps = 60,
+    .pacing = (PacingStats){ .frame_ms = 0.0f, .jitter_ms = 0.0f, .worst_ms = 0.0f },
+  };
+}
+
 MeshSettings ObjLoader::load_obj(int argc, char **argv) {
+  LoadOptions opts = { .tinyobj = false, .convert = false, .use_cache = true, .stream = false, .optimize = false, .overdraw = false, .compact = false, .lod = false, .meshlets = false, .scene = false, .pacing = PACING_VSYNC, .target_fps = 60,
+		       .headless = false, .output = nullptr, .width = WIDTH, .height = HEIGHT,
+		       .tex_mode = NO_TEX, .tex_format = TEX_FORMAT_AUTO, .tex_array = false, .batch = false, .turntable = false, .loaders = 0, .contexts = 1,
+		       .bench = 0.0f, .csv = nullptr };
+  argc = take_options(argc, argv, &opts);
+
   uint32_t count = 0; 
   while(argv[++count] != NULL);
   
@@ -36,7 +361,9 @@ MeshSettings ObjLoader::load_obj(int argc, char **argv) {
       std::cout << LIGHT_KEY << std::endl;
       std::cout << TEX_ORTHO << std::endl;
       std::cout << TEX_CIL << std::endl;
-      std::cout << TEX_SPH << std::endl << std::endl;
+      std::cout << TEX_SPH << std::endl;
+      std::cout << TEX_UV << std::endl;
+      std::cout << TEX_LAYER_KEY << std::endl << std::endl;
       std::cout << KEYS << std::endl;
     } break;
     case 'h':
@@ -46,165 +373,407 @@ MeshSettings ObjLoader::load_obj(int argc, char **argv) {
       	  std::cout << "opções: " << std::endl;
 	  std::cout << "-h: mostra essa mensagem." << std::endl;
 	  std::cout << "-k: mostra a mensagem de controles." << std::endl;
+	  std::cout << "--tinyobj: usa o tinyobj como parser (referencia)." << std::endl;
+	  std::cout << "--convert a.obj [b.obj ...] [tex.png ...]: escreve o cache binario (.mesh2cache) ao lado de cada .obj" << std::endl;
+	  std::cout << "    e o .ktx2 comprimido de cada textura." << std::endl;
+	  std::cout << "--no-cache: ignora os caches (.mesh2cache e .ktx2), faz o parse do .obj e o decode da textura." << std::endl;
+	  std::cout << "--stream: abre a janela na hora e desenha a malha enquanto ela e carregada." << std::endl;
+	  std::cout << "--optimize: reordena triangulos e vertices para o cache de vertices da GPU." << std::endl;
+	  std::cout << "--overdraw: --optimize e ordena clusters de fora para dentro para reduzir overdraw." << std::endl;
+	  std::cout << "--lod: gera LODs com 1/2, 1/4 e 1/8 dos triangulos, escolhidas pelo tamanho na tela." << std::endl;
+	  std::cout << "--meshlets: divide a malha em meshlets e descarta os fora da tela ou de costas." << std::endl;
+	  std::cout << "--scene a.obj b.obj ... | --scene cena.txt: carrega varias malhas numa cena, em paralelo." << std::endl;
+	  std::cout << "    cada linha do manifesto: caminho.obj [x y z [escala]]" << std::endl;
+	  std::cout << "--vsync: um frame por atualizacao do monitor (padrao)." << std::endl;
+	  std::cout << "--fps N: limita a N frames por segundo, sem vsync." << std::endl;
+	  std::cout << "--uncapped: sem vsync e sem limite, para medir o throughput." << std::endl;
+	  std::cout << "--headless: sem janela, desenha um frame num contexto EGL e grava um PNG." << std::endl;
+	  std::cout << "    --out arquivo.png (padrao: <obj>.png), --size LxA (padrao: 1280x720)" << std::endl;
+	  std::cout << "--batch dir|lista.txt [tex.png]: thumbnail de cada .obj, sem janela, com --out dir e --size." << std::endl;
+	  std::cout << "    --turntable: 36 frames por malha (uma volta); --loaders N, --contexts N: threads de parse e contextos GL" << std::endl;
+	  std::cout << "--tex ortho|cil|sph|uv: modo de textura inicial." << std::endl;
+	  std::cout << "--texarray: carrega todas as texturas depois do .obj de uma vez; (t) ou o painel mesh trocam a textura." << std::endl;
+	  std::cout << "--texfmt auto|none|bc1|bc3|bc7: compressao da textura, guardada em <tex>.ktx2 (padrao: auto)." << std::endl;
+	  std::cout << "--bench N: gira a malha por N segundos sem vsync e grava p50/p95/p99/max de CPU e GPU." << std::endl;
+	  std::cout << "    --csv arquivo.csv: amostras por frame (padrao: <obj>.bench.csv)" << std::endl;
+	  std::cout << "--compact: vertices de 16 bytes (posicao 16 bits, normal octaedrica, cor RGBA8) e indices de 16 bits." << std::endl;
     } break;
     }
     exit(0);
   }
   
-  tinyobj::ObjReaderConfig reader_config;
-  reader_config.mtl_search_path = "./models/"; // Path to material files
+  if (opts.convert) {
+    // escreve o cache de cada .obj (e de cada textura) e termina
+    for (int i = 1; i < argc; i++) {
+      if (is_image(argv[i])) {
+	// textura: sem contexto GL, todos os formatos valem
+	if (opts.tex_format == TEX_FORMAT_NONE) continue;
+	TextureImage image;
+	uint32_t all = 1u << TEX_FORMAT_BC1 | 1u << TEX_FORMAT_BC3 | 1u << TEX_FORMAT_BC7;
+	if (!TextureLoader::prepare(argv[i], opts.tex_format, all, false, &image)) exit(1);
+	if (!TextureCache::write(argv[i], image)) exit(1);
+	std::cout << "cache escrito: " << TextureCache::cache_path(argv[i]) << std::endl;
+	continue;
+      }
+      LoadOptions convert_opts = opts;
+      convert_opts.use_cache = false;
+      MeshSettings m = ObjLoader::load_file(argv[i], nullptr, convert_opts);
+      if (!MeshCache::write(argv[i], &m, cache_flags(convert_opts))) exit(1);
+      std::cout << "cache escrito: " << MeshCache::cache_path(argv[i]) << std::endl;
+    }
+    exit(0);
+  }
 
-  tinyobj::ObjReader reader;
+  MeshSettings m;
+  if (opts.batch) {
+    // as malhas sao carregadas pelas threads do BatchRenderer
+    if (opts.tex_array) std::cout << "--texarray ignorado com --batch" << std::endl;
+    m = make_settings(argv[1], argv[2]);
+    m.batch = new BatchRenderer(argv[1], argv[2], opts);
+    return m;
+  } else if (opts.scene) {
+    std::vector<SceneEntry> entries;
+    // textura opcional no fim, compartilhada pelas partes
+    const char *tex_file = nullptr;
+    if (argc > 2 && is_image(argv[argc - 1])) tex_file = argv[--argc];
+    if (argc == 2 && !ends_with(argv[1], ".obj")) {
+      entries = SceneLoader::read_manifest(argv[1]);
+    } else {
+      for (int i = 1; i < argc; i++) entries.push_back((SceneEntry){ .obj_file = argv[i], .offset = glm::vec3(0.0f), .scale = 1.0f });
+    }
+    // cada parte desenha a faixa inteira dela
+    LoadOptions part_opts = opts;
+    if (opts.lod || opts.meshlets) std::cout << "--lod e --meshlets ignorados com --scene" << std::endl;
+    part_opts.lod = false;
+    part_opts.meshlets = false;
+    m = SceneLoader::load(argv[1], entries, part_opts);
+    m.tex_file = tex_file;
+  } else if (opts.stream && !opts.tinyobj && !opts.headless) {
+    m = make_settings(argv[1], argv[2]);
+    if (!opts.use_cache || !MeshCache::map(argv[1], &m, cache_flags(opts))) {
+      m.stream = new StreamLoader(argv[1], opts);
+      m.stream->start();
+    }
+  } else {
+    m = ObjLoader::load_file(argv[1], argv[2], opts);
+  }
+  m.compact = opts.compact;
+  m.pacing_mode = opts.pacing;
+  m.target_fps = opts.target_fps;
+  m.tex_mode = (TEXTURE_MODE)opts.tex_mode;
+  m.tex_format = (TEXTURE_FORMAT)opts.tex_format;
+  m.tex_cache = opts.use_cache;
+  if (opts.tex_array && opts.scene) {
+    std::cout << "--texarray ignorado com --scene" << std::endl;
+  } else if (opts.tex_array) {
+    // argv[2] continua como tex_file, o nome mostrado antes da troca
+    if (argc < 3) {
+      std::cerr << "--texarray espera as texturas depois do .obj." << std::endl;
+      exit(1);
+    }
+    for (int i = 2; i < argc; i++) m.tex_layers.push_back(argv[i]);
+  }
+  if (opts.bench > 0.0f) {
+    // mede o que a malha custa, sem esperar o monitor (a nao ser com --fps N)
+    if (m.pacing_mode == PACING_VSYNC) m.pacing_mode = PACING_UNCAPPED;
+    std::string csv = opts.csv != nullptr ? opts.csv : std::string(argv[1]) + ".bench.csv";
+    m.bench = new FrameBench(opts.bench, csv.c_str());
+  }
+  if (opts.headless) {
+    // sem janela o tamanho do frame vem do --size
+    if (opts.stream) std::cout << "--stream ignorado com --headless" << std::endl;
+    m.resolution = glm::vec2(opts.width, opts.height);
+    if (opts.output != nullptr) {
+      m.output = opts.output;
+    } else {
+      std::string out = argv[1];
+      size_t dot = out.find_last_of('.');
+      if (dot != std::string::npos && out.find('/', dot) == std::string::npos) out.resize(dot);
+      m.output = strdup((out + ".png").c_str());
+    }
+  }
+  return m;
+}
 
-  if (!reader.ParseFromFile(argv[1], reader_config)) {
-    if (!reader.Error().empty()) {
-      std::cerr << "TinyObjReader: " << reader.Error();
+MeshSettings ObjLoader::load_file(const char *obj_file, const char *tex_file, const LoadOptions &opts) {
+  MeshSettings m;
+  if (!ObjLoader::load_file(obj_file, tex_file, opts, &m)) exit(1);
+  return m;
+}
+
+bool ObjLoader::load_file(const char *obj_file, const char *tex_file, const LoadOptions &opts, MeshSettings *m) {
+  auto load_start = std::chrono::steady_clock::now();
+  auto stage_start = load_start;
+
+  *m = make_settings(obj_file, tex_file);
+  if (opts.use_cache && !opts.tinyobj) {
+    if (MeshCache::map(obj_file, m, cache_flags(opts))) {
+      std::cout << "cache: " << elapsed_ms(stage_start) << " ms (" << m->t_verts << " vertices, " << mesh_base_index_count(m) / 3 << " triangulos)" << std::endl;
+      return true;
     }
-    exit(1);
   }
 
-  if (!reader.Warning().empty()) {
-    std::cout << "TinyObjReader: " << reader.Warning();
+  ObjData data;
+  if (!ObjLoader::parse(obj_file, opts, &data)) return false;
+
+  std::cout << "parse: " << elapsed_ms(stage_start) << " ms" << std::endl;
+
+  if (!ObjLoader::build(data, opts, m)) return false;
+  std::cout << "load_obj total: " << elapsed_ms(load_start) << " ms (" << m->t_verts << " vertices, " << mesh_base_index_count(m) / 3 << " triangulos)" << std::endl;
+  return true;
+}
+
+bool ObjLoader::dedupe(const ObjData &data, std::vector<Vertex> *verts, std::vector<uint32_t> *indices,
+		       std::vector<uint8_t> *needs_normal, bool *has_texcoords, size_t *missing_normals) {
+  VertexTable vertex_idx(data.vertices.size() / 3); // cresce com as costuras de normal e uv
+  verts->clear();
+  indices->clear();
+  needs_normal->clear();
+  verts->reserve(data.vertices.size() / 3);
+  indices->reserve(data.indices.size());
+  needs_normal->reserve(data.vertices.size() / 3);
+  *missing_normals = 0;
+  *has_texcoords = false;
+
+  uint32_t chan = 0;
+  for (size_t i = 0; i < data.indices.size(); i++) {
+    const ObjIndex &idx = data.indices[i];
+    if (idx.vertex_index < 0 || (size_t)idx.vertex_index >= data.vertices.size() / 3) {
+      std::cerr << "indice de vertice invalido: " << idx.vertex_index + 1 << std::endl;
+      return false;
+    }
+
+    uint32_t slot = vertex_idx.find_or_insert(idx);
+    if (slot == EMPTY_SLOT) {
+
+      float vx = data.vertices[3*(uint32_t)(idx.vertex_index)+0];
+      float vy = data.vertices[3*(uint32_t)(idx.vertex_index)+1];
+      float vz = data.vertices[3*(uint32_t)(idx.vertex_index)+2];
+
+      glm::vec4 position = glm::vec4(vx, vy, vz, 1.0f);
+
+      glm::vec3 normal = glm::vec3(0.f);
+      bool file_normal = idx.normal_index >= 0 && (size_t)idx.normal_index < data.normals.size() / 3;
+      if (file_normal) {
+	normal = glm::vec3(data.normals[3*(uint32_t)(idx.normal_index)+0],
+			   data.normals[3*(uint32_t)(idx.normal_index)+1],
+			   data.normals[3*(uint32_t)(idx.normal_index)+2]);
+      } else {
+	(*missing_normals)++;
+      }
+      needs_normal->push_back(!file_normal);
+
+      glm::vec2 texcoord = glm::vec2(0.f);
+      if (idx.texcoord_index >= 0 && (size_t)idx.texcoord_index < data.texcoords.size() / 2) {
+	texcoord = glm::vec2(data.texcoords[2*(uint32_t)(idx.texcoord_index)+0],
+			     data.texcoords[2*(uint32_t)(idx.texcoord_index)+1]);
+	*has_texcoords = true;
+      }
+
+      glm::vec4 color = glm::vec4(0.5f, 0.0f, .5f, 1.0f);
+      if (chan == 1) {
+	color = glm::vec4(.2f, .5f, 0.0f, 1.0f);
+      } else if (chan == 2) {
+	color = glm::vec4(0.0f, 0.2f, 1.0f, 1.0f);
+      }
+      chan = (chan + 1) % 3;
+      verts->push_back((Vertex){ .position = position, .normal = normal, .color = color, .texcoord = texcoord });
+      slot = verts->size() - 1;
+    }
+    indices->push_back(slot);
   }
+  return true;
+}
 
-  auto& attrib = reader.GetAttrib();
-  auto& shapes = reader.GetShapes();
-  auto& materials = reader.GetMaterials();
+void ObjLoader::compute_bounds(const std::vector<Vertex> &verts, glm::vec3 *bbox_min, glm::vec3 *bbox_max) {
+  uint32_t workers = parallel_workers(verts.size(), POST_GRAIN);
+  std::vector<glm::vec3> mins(workers, glm::vec3(FLT_MAX));
+  std::vector<glm::vec3> maxs(workers, glm::vec3(-FLT_MAX));
 
-  if (shapes.size() < 1) {
-    std::cout << "precisa de pelo menos 1 shape." << std::endl;
-    exit(1);
+  parallel_for(verts.size(), POST_GRAIN, [&](size_t begin, size_t end, uint32_t w) {
+#ifdef __SSE__
+    // position e o primeiro membro do Vertex: x y z w contiguos
+    __m128 lo = _mm_set1_ps(FLT_MAX);
+    __m128 hi = _mm_set1_ps(-FLT_MAX);
+    for (size_t i = begin; i < end; i++) {
+      __m128 p = _mm_loadu_ps(&verts[i].position.x);
+      lo = _mm_min_ps(lo, p);
+      hi = _mm_max_ps(hi, p);
+    }
+    float l[4], h[4];
+    _mm_storeu_ps(l, lo);
+    _mm_storeu_ps(h, hi);
+    mins[w] = glm::vec3(l[0], l[1], l[2]);
+    maxs[w] = glm::vec3(h[0], h[1], h[2]);
+#else
+    for (size_t i = begin; i < end; i++) {
+      glm::vec3 p = glm::vec3(verts[i].position);
+      mins[w] = glm::min(mins[w], p);
+      maxs[w] = glm::max(maxs[w], p);
+    }
+#endif
+  });
+
+  *bbox_min = glm::vec3(FLT_MAX);
+  *bbox_max = glm::vec3(-FLT_MAX);
+  for (uint32_t w = 0; w < workers; w++) {
+    *bbox_min = glm::min(*bbox_min, mins[w]);
+    *bbox_max = glm::max(*bbox_max, maxs[w]);
   }
+}
 
-  float min_x = FLT_MAX;
-  float max_x = FLT_MIN;
-  float min_y = FLT_MAX;
-  float max_y = FLT_MIN;
-  float min_z = FLT_MAX;
-  float max_z = FLT_MIN;
+void ObjLoader::generate_normals(const std::vector<uint32_t> &indices, const std::vector<uint8_t> &needs_normal, std::vector<Vertex> *verts) {
+  size_t t_tris = indices.size() / 3;
+  std::vector<glm::vec3> face_normals(t_tris);
+  Vertex *v = verts->data();
 
+  // calculate triangle normal
+  parallel_for(t_tris, POST_GRAIN, [&](size_t begin, size_t end, uint32_t) {
+    for (size_t t = begin; t < end; t++) {
+      glm::vec3 p1 = glm::vec3(v[indices[3*t+0]].position);
+      glm::vec3 p2 = glm::vec3(v[indices[3*t+1]].position);
+      glm::vec3 p3 = glm::vec3(v[indices[3*t+2]].position);
+      face_normals[t] = glm::cross(p2 - p1, p3 - p1);
+    }
+  });
 
-  std::vector<uint32_t> indices;
-  std::vector<Vertex> verts;
-  std::map<uint32_t, uint32_t> vertex_idx; // mapea o index do tiny e  -> index do verts
+  // triangulos de cada vertice (CSR): cada thread conta os cantos da sua faixa
+  // de indices num histograma proprio, a soma de prefixo por vertice da a cada
+  // thread um pedaco disjunto da lista e o fill repete as mesmas faixas. A
+  // ordem dos triangulos fica a dos indices, a soma sai igual a serial
+  size_t t_verts = verts->size();
+  size_t t_index = indices.size();
+  uint32_t workers = parallel_workers(t_index, POST_GRAIN);
+  std::vector<std::vector<uint32_t> > offsets(workers);
+  parallel_for(t_index, POST_GRAIN, [&](size_t begin, size_t end, uint32_t w) {
+    std::vector<uint32_t> &count = offsets[w];
+    count.assign(t_verts, 0);
+    for (size_t i = begin; i < end; i++) if (needs_normal[indices[i]]) count[indices[i]]++;
+  });
 
-  uint32_t chan = 0;
-  // Loop over shapes
-  for (uint32_t s = 0; s < shapes.size(); s++) {
-    // Loop over faces(polygon)
-    uint32_t index_offset = 0;
-    for (uint32_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); f++) {
-      uint32_t fv = (uint32_t)(shapes[s].mesh.num_face_vertices[f]);
-
-      // Loop over vertices in the face.
-      for (uint32_t v = 0; v < fv; v++) {	
-	// access to vertex
-	tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
-
-	if (vertex_idx.find(idx.vertex_index) == vertex_idx.end()) {
-
-	  tinyobj::real_t vx = attrib.vertices[3*(uint32_t)(idx.vertex_index)+0];
-	  tinyobj::real_t vy = attrib.vertices[3*(uint32_t)(idx.vertex_index)+1];
-	  tinyobj::real_t vz = attrib.vertices[3*(uint32_t)(idx.vertex_index)+2];
-	
-	  min_x = std::min(min_x, vx);
-	  max_x = std::max(max_x, vx);
-	  min_y = std::min(min_y, vy);
-	  max_y = std::max(max_y, vy);
-	  min_z = std::min(min_z, vz);
-	  max_z = std::max(max_z, vz);
-	
-	  glm::vec4 position = glm::vec4(vx, vy, vz, 1.0f);
-
-	  glm::vec3 normal = glm::vec3(0.f);
-	
-	  glm::vec4 color = glm::vec4(0.5f, 0.0f, .5f, 1.0f);
-	  if (chan == 1) {
-	    color = glm::vec4(.2f, .5f, 0.0f, 1.0f);
-	  } else if (chan == 2) {
-	    color = glm::vec4(0.0f, 0.2f, 1.0f, 1.0f);
-	  }
-	  chan = (chan + 1) % 3;
-	  verts.push_back((Vertex){ .position = position, .normal = normal, .color = color });
-	  vertex_idx[idx.vertex_index] = verts.size() - 1;
-	  indices.push_back(verts.size() - 1);
-	} else {
-	  indices.push_back(vertex_idx[idx.vertex_index]);
-	}
+  // grau de cada vertice e o inicio de cada thread dentro dele
+  std::vector<uint32_t> first(t_verts + 1, 0);
+  parallel_for(t_verts, POST_GRAIN, [&](size_t begin, size_t end, uint32_t) {
+    for (size_t vi = begin; vi < end; vi++) {
+      uint32_t total = 0;
+      for (uint32_t w = 0; w < workers; w++) {
+	uint32_t c = offsets[w][vi];
+	offsets[w][vi] = total;
+	total += c;
       }
-      index_offset += fv;
+      first[vi + 1] = total;
+    }
+  });
+  for (size_t vi = 0; vi < t_verts; vi++) first[vi + 1] += first[vi];
 
-      // per-face material
-      //shapes[s].mesh.material_ids[f];
+  std::vector<uint32_t> tris(first[t_verts]);
+  parallel_for(t_index, POST_GRAIN, [&](size_t begin, size_t end, uint32_t w) {
+    std::vector<uint32_t> &fill = offsets[w];
+    for (size_t i = begin; i < end; i++) {
+      uint32_t vi = indices[i];
+      if (needs_normal[vi]) tris[first[vi] + fill[vi]++] = (uint32_t)(i / 3);
     }
+  });
+  offsets = std::vector<std::vector<uint32_t> >();
+
+  // cada thread e dona de uma faixa de vertices e so le os triangulos deles
+  parallel_for(t_verts, POST_GRAIN, [&](size_t begin, size_t end, uint32_t) {
+    for (size_t vi = begin; vi < end; vi++) {
+      if (!needs_normal[vi]) continue;
+      for (uint32_t k = first[vi]; k < first[vi + 1]; k++) v[vi].normal += face_normals[tris[k]];
+    }
+  });
+}
+
+void ObjLoader::normalize(glm::vec3 center, float escala, std::vector<Vertex> *verts) {
+  Vertex *v = verts->data();
+  parallel_for(verts->size(), POST_GRAIN, [&](size_t begin, size_t end, uint32_t) {
+    for (size_t i = begin; i < end; i++) {
+      // normais aculumadas normalizadas
+      v[i].normal = glm::normalize(v[i].normal);
+      // aplica translacao -centro e escala
+      v[i].position = glm::vec4((glm::vec3(v[i].position) - center) * escala, 1.0f);
+    }
+  });
+}
+
+bool ObjLoader::build(const ObjData &data, const LoadOptions &opts, MeshSettings *mesh_set) {
+  auto stage_start = std::chrono::steady_clock::now();
+
+  if (data.indices.size() < 3) {
+    std::cout << "precisa de pelo menos 1 triangulo." << std::endl;
+    return false;
   }
 
-  glm::vec3 center = glm::vec3(0.0f);
+  std::vector<uint32_t> indices;
+  std::vector<Vertex> verts;
+  std::vector<uint8_t> needs_normal; // vertices sem normal no arquivo
+  bool has_texcoords = false;
+  size_t missing_normals = 0;
+  if (!ObjLoader::dedupe(data, &verts, &indices, &needs_normal, &has_texcoords, &missing_normals)) return false;
 
-  center.x = (min_x + max_x) / 2.0f;
-  center.y = (min_y + max_y) / 2.0f;
-  center.z = (min_z + max_z) / 2.0f;
+  std::cout << "dedupe: " << elapsed_ms(stage_start) << " ms" << std::endl;
+  stage_start = std::chrono::steady_clock::now();
 
-  float tam_x = max_x - min_x;
-  float tam_y = max_y - min_y;
-  float tam_z = max_z - min_z;
-  
-  float maior_dim = std::max(std::max(tam_x, tam_y), tam_z);
-  
-  float escala = 1.0f / maior_dim;
+  glm::vec3 bbox_min, bbox_max;
+  ObjLoader::compute_bounds(verts, &bbox_min, &bbox_max);
+
+  std::cout << "caixa envolvente: " << elapsed_ms(stage_start) << " ms" << std::endl;
+  stage_start = std::chrono::steady_clock::now();
+
+  glm::vec3 center = (bbox_min + bbox_max) / 2.0f;
+  glm::vec3 tam = bbox_max - bbox_min;
+  float maior_dim = std::max(std::max(tam.x, tam.y), tam.z);
+  float escala = maior_dim > 0.0f ? 1.0f / maior_dim : 1.0f;
 
   std::cout << escala << std::endl;
 
-  // calculate triangle normal
-  for (uint32_t i = 0; i < indices.size(); i += 3) {
-    uint64_t i1 = indices[i+0];
-    uint64_t i2 = indices[i+1];
-    uint64_t i3 = indices[i+2];
-    glm::vec3 p1 = glm::vec3(verts[i1].position.x, verts[i1].position.y, verts[i1].position.z);
-    glm::vec3 p2 = glm::vec3(verts[i2].position.x, verts[i2].position.y, verts[i2].position.z);
-    glm::vec3 p3 = glm::vec3(verts[i3].position.x, verts[i3].position.y, verts[i3].position.z);
-    glm::vec3 normal = glm::cross(p2 - p1, p3 - p1);
-    
-    verts[i1].normal += normal;
-    verts[i2].normal += normal;
-    verts[i3].normal += normal;
-    //std::cout << glm::to_string(normal) << std::endl;
-  }
-
-  for (uint32_t i = 0; i < verts.size(); ++i) {
-    // normais aculumadas normalizadas
-    verts[i].normal = glm::normalize(verts[i].normal);
-    // aplica translacao -centro e escala 
-    verts[i].position = glm::vec4((glm::vec3(verts[i].position) - center) * escala, 1.0f);
+  if (missing_normals > 0) {
+    ObjLoader::generate_normals(indices, needs_normal, &verts);
+    std::cout << "normais: " << elapsed_ms(stage_start) << " ms (" << missing_normals << " vertices sem normal no arquivo)" << std::endl;
+  } else {
+    std::cout << "normais: do arquivo" << std::endl;
   }
-  
-  return (MeshSettings){
-    .obj_file = argv[1],
-    .tex_file = argv[2],
-    .resolution = glm::vec2(WIDTH, HEIGHT),
-    .mode = FILL_POLYGON,
-    .tex_mode = NO_TEX,
-    .vertices = verts,
-    .t_verts = verts.size(),
-    .indices = indices,
-    .t_index = indices.size(),
-    .center = center,
-    .mouse_pos = glm::vec2(0.0f),
-    .rotating = false,
-    .rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f),
-    .translate = glm::vec3(0.0f),
-    .scale = glm::vec3(1.0f),
-    .scale_factor = 0.01f,
-    .color = glm::vec4(0.466f, 0.363f, 0.755f, 1.0f),
-    .bg_color = glm::vec4(0.150f, 0.151f, 0.167f, 1.000f),
-    .stroke = 1.0f,
-    .light = false,
-    .camera_position = glm::vec3(0.0f, 0.0f, 3.0f),
-    .light_position = glm::vec3(1.0f, 0.0f, 2.0f),
-    .light_color = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f),
-    .ka = 0.5f,
-    .kd = 0.8f,
-    .ks = 1.0f,
-    .ksb = 3.0f,
-  };
+  stage_start = std::chrono::steady_clock::now();
+
+  ObjLoader::normalize(center, escala, &verts);
+
+  std::cout << "normalizacao: " << elapsed_ms(stage_start) << " ms" << std::endl;
+
+  mesh_set->cache_before = MeshOptimizer::analyze(indices.data(), indices.size(), verts.size());
+  mesh_set->cache_after = mesh_set->cache_before;
+  if (opts.optimize) {
+    stage_start = std::chrono::steady_clock::now();
+    MeshOptimizer::optimize_vertex_cache(&indices, verts.size());
+    if (opts.overdraw) MeshOptimizer::optimize_overdraw(&indices, verts);
+    MeshOptimizer::optimize_vertex_fetch(&indices, &verts);
+    mesh_set->cache_after = MeshOptimizer::analyze(indices.data(), indices.size(), verts.size());
+    std::cout << "otimizacao: " << elapsed_ms(stage_start) << " ms (ACMR " << mesh_set->cache_before.acmr << " -> " << mesh_set->cache_after.acmr
+	      << ", ATVR " << mesh_set->cache_before.atvr << " -> " << mesh_set->cache_after.atvr << ")" << std::endl;
+  }
+
+  if (opts.meshlets) {
+    stage_start = std::chrono::steady_clock::now();
+    MeshletBuilder::build(&indices, indices.size(), verts, &mesh_set->meshlets);
+    std::cout << "meshlets: " << elapsed_ms(stage_start) << " ms (" << mesh_set->meshlets.size() << " meshlets)" << std::endl;
+  }
+
+  if (opts.lod) {
+    stage_start = std::chrono::steady_clock::now();
+    MeshSimplifier::build_lods(&indices, verts, opts.optimize, &mesh_set->lods);
+    std::cout << "lods: " << elapsed_ms(stage_start) << " ms (";
+    for (size_t l = 0; l < mesh_set->lods.size(); l++) std::cout << (l ? ", " : "") << mesh_set->lods[l].count / 3;
+    std::cout << " triangulos)" << std::endl;
+  }
+
+  mesh_set->vertices.swap(verts);
+  mesh_set->t_verts = mesh_set->vertices.size();
+  mesh_set->indices.swap(indices);
+  mesh_set->t_index = mesh_set->indices.size();
+  mesh_set->has_texcoords = has_texcoords;
+  mesh_set->center = center;
+  mesh_set->escala = escala;
+  mesh_set->bbox_min = (bbox_min - center) * escala;
+  mesh_set->bbox_max = (bbox_max - center) * escala;
+  return true;
 }
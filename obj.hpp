@@ -2,11 +2,54 @@
 #define OBJ_H
 
 #include "mesh.hpp"
+#include "parser.hpp"
+
+typedef struct {
+  bool tinyobj;   // usa o tinyobj::ObjReader no lugar do ObjParser
+  bool convert;   // so escreve o cache binario e termina
+  bool use_cache; // usa o cache binario quando valido
+  bool stream;    // carrega numa thread enquanto a janela ja desenha
+  bool optimize;  // reordena para o cache de vertices (Forsyth) e para o fetch
+  bool overdraw;  // tambem ordena clusters para reduzir overdraw
+  bool compact;   // sobe os vertices quantizados (CompactVertex)
+  bool lod;       // gera LODs simplificadas no mesmo VBO
+  bool meshlets;  // divide a LOD0 em meshlets para o culling
+  bool scene;     // varios .obj (ou um manifesto) numa cena so
+  int pacing;     // PACING_MODE inicial (--vsync, --fps N, --uncapped)
+  int target_fps;
+  bool headless;      // sem janela: contexto EGL, desenha num FBO e grava um PNG
+  const char *output; // PNG do --headless (padrao <obj>.png) ou diretorio do --batch
+  int width;          // tamanho do --headless (--size LxA)
+  int height;
+  int tex_mode;       // TEXTURE_MODE inicial (--tex)
+  int tex_format;     // TEXTURE_FORMAT (--texfmt)
+  bool tex_array;     // --texarray: as texturas depois do .obj num GL_TEXTURE_2D_ARRAY
+  bool batch;         // --batch: thumbnails de um diretorio ou lista de .obj
+  bool turntable;     // --batch com BATCH_TURNTABLE_FRAMES frames por malha
+  int loaders;        // threads de parse do --batch, 0: uma por nucleo livre
+  int contexts;       // contextos GL do --batch
+  float bench;        // --bench N: segundos de orbita medida, 0 desliga
+  const char *csv;    // amostras do --bench, padrao <obj>.bench.csv
+} LoadOptions;
 
 class ObjLoader
 {
 public:
   static MeshSettings load_obj(int argc, char **argv);
+  static MeshSettings load_file(const char *obj_file, const char *tex_file, const LoadOptions &opts);
+  // igual, mas devolve false em vez de sair (o --batch pula o arquivo)
+  static bool load_file(const char *obj_file, const char *tex_file, const LoadOptions &opts, MeshSettings *mesh_set);
+  static MeshSettings make_settings(const char *obj_file, const char *tex_file);
+  static bool parse(const char *path, const LoadOptions &opts, ObjData *data);
+  // dedupe, caixa envolvente, normais e normalizacao; preenche a geometria do mesh_set
+  static bool build(const ObjData &data, const LoadOptions &opts, MeshSettings *mesh_set);
+
+  // etapas do build; missing_normals conta os vertices sem normal do arquivo
+  static bool dedupe(const ObjData &data, std::vector<Vertex> *verts, std::vector<uint32_t> *indices,
+		     std::vector<uint8_t> *needs_normal, bool *has_texcoords, size_t *missing_normals);
+  static void compute_bounds(const std::vector<Vertex> &verts, glm::vec3 *bbox_min, glm::vec3 *bbox_max);
+  static void generate_normals(const std::vector<uint32_t> &indices, const std::vector<uint8_t> &needs_normal, std::vector<Vertex> *verts);
+  static void normalize(glm::vec3 center, float escala, std::vector<Vertex> *verts);
 };
 
 
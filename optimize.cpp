@@ -0,0 +1,211 @@
+#include "optimize.hpp"
+#include <cmath>
+#include <algorithm>
+
+#define NO_VERTEX 0xFFFFFFFFu
+
+VertexCacheStats MeshOptimizer::analyze(const uint32_t *indices, size_t t_index, size_t t_verts) {
+  VertexCacheStats stats = { .acmr = 0.0f, .atvr = 0.0f };
+  if (t_index < 3 || t_verts == 0) return stats;
+
+  // cache FIFO: o vertice esta no cache se entrou ha menos de STATS_CACHE_SIZE misses
+  std::vector<uint32_t> timestamp(t_verts, 0);
+  uint32_t time = STATS_CACHE_SIZE + 1;
+  size_t misses = 0;
+  size_t unique = 0;
+  for (size_t i = 0; i < t_index; i++) {
+    uint32_t v = indices[i];
+    if (timestamp[v] == 0) unique++;
+    if (time - timestamp[v] > STATS_CACHE_SIZE) {
+      timestamp[v] = time++;
+      misses++;
+    }
+  }
+  stats.acmr = (float)misses / (float)(t_index / 3);
+  stats.atvr = (float)misses / (float)unique;
+  return stats;
+}
+
+static float vertex_score(int cache_pos, uint32_t valence) {
+  if (valence == 0) return -1.0f;
+  float score = 0.0f;
+  if (cache_pos >= 0) {
+    // os 3 do ultimo triangulo tem peso fixo para nao favorecer tiras longas
+    if (cache_pos < 3) score = 0.75f;
+    else score = powf(1.0f - (float)(cache_pos - 3) / (FORSYTH_CACHE_SIZE - 3), 1.5f);
+  }
+  // vertices com poucos triangulos restantes saem antes
+  return score + 2.0f * powf((float)valence, -0.5f);
+}
+
+void MeshOptimizer::optimize_vertex_cache(std::vector<uint32_t> *indices, size_t t_verts) {
+  const std::vector<uint32_t> &in = *indices;
+  size_t t_tris = in.size() / 3;
+  if (t_tris == 0) return;
+
+  // adjacencia vertice -> triangulos em CSR, valence = triangulos ainda nao emitidos
+  std::vector<uint32_t> valence(t_verts, 0);
+  for (size_t i = 0; i < in.size(); i++) valence[in[i]]++;
+  std::vector<uint32_t> offsets(t_verts + 1, 0);
+  for (size_t v = 0; v < t_verts; v++) offsets[v + 1] = offsets[v] + valence[v];
+  std::vector<uint32_t> adjacency(in.size());
+  {
+    std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < in.size(); i++) adjacency[cursor[in[i]]++] = (uint32_t)(i / 3);
+  }
+
+  std::vector<int> cache_pos(t_verts, -1);
+  std::vector<float> score(t_verts);
+  for (size_t v = 0; v < t_verts; v++) score[v] = vertex_score(-1, valence[v]);
+
+  std::vector<float> tri_score(t_tris);
+  std::vector<uint8_t> emitted(t_tris, 0);
+  size_t best = 0;
+  for (size_t t = 0; t < t_tris; t++) {
+    tri_score[t] = score[in[3*t+0]] + score[in[3*t+1]] + score[in[3*t+2]];
+    if (tri_score[t] > tri_score[best]) best = t;
+  }
+
+  std::vector<uint32_t> out;
+  out.reserve(in.size());
+  uint32_t cache[FORSYTH_CACHE_SIZE + 3];
+  uint32_t new_cache[FORSYTH_CACHE_SIZE + 3];
+  uint32_t cache_count = 0;
+  size_t next_scan = 0;
+
+  while (true) {
+    const uint32_t *tri = &in[3 * best];
+    emitted[best] = 1;
+    out.insert(out.end(), tri, tri + 3);
+    if (out.size() == in.size()) break;
+
+    // tira o triangulo das listas dos seus vertices
+    for (int c = 0; c < 3; c++) {
+      uint32_t v = tri[c];
+      uint32_t *list = &adjacency[offsets[v]];
+      for (uint32_t k = 0; k < valence[v]; k++) {
+	if (list[k] == best) {
+	  std::swap(list[k], list[valence[v] - 1]);
+	  valence[v]--;
+	  break;
+	}
+      }
+    }
+
+    // LRU: o triangulo emitido vai para a frente
+    uint32_t new_count = 0;
+    for (int c = 0; c < 3; c++) new_cache[new_count++] = tri[c];
+    for (uint32_t k = 0; k < cache_count; k++) {
+      uint32_t v = cache[k];
+      if (v != tri[0] && v != tri[1] && v != tri[2]) new_cache[new_count++] = v;
+    }
+
+    // recalcula os scores de quem esta (ou acabou de sair) do cache
+    for (uint32_t k = 0; k < new_count; k++) {
+      uint32_t v = new_cache[k];
+      cache_pos[v] = k < FORSYTH_CACHE_SIZE ? (int)k : -1;
+      float new_score = vertex_score(cache_pos[v], valence[v]);
+      float delta = new_score - score[v];
+      score[v] = new_score;
+      for (uint32_t a = 0; a < valence[v]; a++) tri_score[adjacency[offsets[v] + a]] += delta;
+    }
+
+    cache_count = std::min<uint32_t>(new_count, FORSYTH_CACHE_SIZE);
+    std::copy(new_cache, new_cache + cache_count, cache);
+
+    // melhor triangulo entre os vizinhos do cache
+    float best_score = -1.0f;
+    bool found = false;
+    for (uint32_t k = 0; k < cache_count; k++) {
+      uint32_t v = cache[k];
+      for (uint32_t a = 0; a < valence[v]; a++) {
+	uint32_t t = adjacency[offsets[v] + a];
+	if (tri_score[t] > best_score) {
+	  best_score = tri_score[t];
+	  best = t;
+	  found = true;
+	}
+      }
+    }
+    if (!found) {
+      // cache sem vizinhos: pega o proximo triangulo nao emitido na ordem original
+      while (emitted[next_scan]) next_scan++;
+      best = next_scan;
+    }
+  }
+  indices->swap(out);
+}
+
+void MeshOptimizer::optimize_overdraw(std::vector<uint32_t> *indices, const std::vector<Vertex> &verts) {
+  const std::vector<uint32_t> &in = *indices;
+  size_t t_tris = in.size() / 3;
+  if (t_tris == 0) return;
+
+  // clusters: corta onde o otimizador de cache pulou (3 misses) ou, passados
+  // OVERDRAW_CLUSTER triangulos, num triangulo que ja perde 2 vertices do cache
+  std::vector<uint32_t> timestamp(verts.size(), 0);
+  uint32_t time = STATS_CACHE_SIZE + 1;
+  std::vector<size_t> starts;
+  for (size_t t = 0; t < t_tris; t++) {
+    uint32_t misses = 0;
+    for (int c = 0; c < 3; c++) {
+      uint32_t v = in[3*t+c];
+      if (time - timestamp[v] > STATS_CACHE_SIZE) {
+	timestamp[v] = time++;
+	misses++;
+      }
+    }
+    size_t size = starts.empty() ? 0 : t - starts.back();
+    if (starts.empty() || misses == 3 || (size >= OVERDRAW_CLUSTER && misses >= 2)) starts.push_back(t);
+  }
+  starts.push_back(t_tris);
+
+  glm::vec3 mesh_centroid = glm::vec3(0.0f);
+  for (size_t v = 0; v < verts.size(); v++) mesh_centroid += glm::vec3(verts[v].position);
+  mesh_centroid /= (float)std::max<size_t>(1, verts.size());
+
+  // clusters mais para fora e virados para fora primeiro: eles tendem a cobrir os de dentro
+  size_t t_clusters = starts.size() - 1;
+  std::vector<float> sort_key(t_clusters);
+  for (size_t c = 0; c < t_clusters; c++) {
+    glm::vec3 centroid = glm::vec3(0.0f);
+    glm::vec3 normal = glm::vec3(0.0f);
+    for (size_t t = starts[c]; t < starts[c + 1]; t++) {
+      glm::vec3 p1 = glm::vec3(verts[in[3*t+0]].position);
+      glm::vec3 p2 = glm::vec3(verts[in[3*t+1]].position);
+      glm::vec3 p3 = glm::vec3(verts[in[3*t+2]].position);
+      centroid += (p1 + p2 + p3) / 3.0f;
+      normal += glm::cross(p2 - p1, p3 - p1);
+    }
+    centroid /= (float)(starts[c + 1] - starts[c]);
+    float len = glm::length(normal);
+    sort_key[c] = len > 0.0f ? glm::dot(centroid - mesh_centroid, normal / len) : 0.0f;
+  }
+
+  std::vector<uint32_t> order(t_clusters);
+  for (size_t c = 0; c < t_clusters; c++) order[c] = (uint32_t)c;
+  std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return sort_key[a] > sort_key[b]; });
+
+  std::vector<uint32_t> out;
+  out.reserve(in.size());
+  for (size_t k = 0; k < t_clusters; k++) {
+    uint32_t c = order[k];
+    out.insert(out.end(), in.begin() + 3 * starts[c], in.begin() + 3 * starts[c + 1]);
+  }
+  indices->swap(out);
+}
+
+void MeshOptimizer::optimize_vertex_fetch(std::vector<uint32_t> *indices, std::vector<Vertex> *verts) {
+  std::vector<uint32_t> remap(verts->size(), NO_VERTEX);
+  std::vector<Vertex> out;
+  out.reserve(verts->size());
+  for (size_t i = 0; i < indices->size(); i++) {
+    uint32_t &v = (*indices)[i];
+    if (remap[v] == NO_VERTEX) {
+      remap[v] = (uint32_t)out.size();
+      out.push_back((*verts)[v]);
+    }
+    v = remap[v];
+  }
+  verts->swap(out);
+}
@@ -0,0 +1,24 @@
+#ifndef OPTIMIZE_H
+#define OPTIMIZE_H
+
+#include "mesh.hpp"
+
+#define FORSYTH_CACHE_SIZE 32  // cache LRU simulado pelo otimizador
+#define STATS_CACHE_SIZE 16    // cache FIFO usado para medir ACMR/ATVR
+#define OVERDRAW_CLUSTER 64    // triangulos a partir dos quais um cluster pode ser cortado
+
+// reordenacao do index buffer na carga, depois do dedupe
+class MeshOptimizer
+{
+public:
+  // ACMR = vertices transformados por triangulo, ATVR = por vertice unico
+  static VertexCacheStats analyze(const uint32_t *indices, size_t t_index, size_t t_verts);
+  // ordem dos triangulos pelo algoritmo do Forsyth (linear-speed vertex cache optimisation)
+  static void optimize_vertex_cache(std::vector<uint32_t> *indices, size_t t_verts);
+  // corta em clusters nos pulos do cache e ordena os clusters de fora para dentro
+  static void optimize_overdraw(std::vector<uint32_t> *indices, const std::vector<Vertex> &verts);
+  // renumera os vertices na ordem do primeiro uso, descarta os nao usados
+  static void optimize_vertex_fetch(std::vector<uint32_t> *indices, std::vector<Vertex> *verts);
+};
+
+#endif /* OPTIMIZE_H */
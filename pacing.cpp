@@ -0,0 +1,63 @@
+#include "pacing.hpp"
+#include <thread>
+#include <cmath>
+#include <GLFW/glfw3.h>
+
+FramePacer::FramePacer() : applied_mode(-1), applied_fps(0), t_history(0), next(0) {
+  deadline = clock::now();
+  last_frame = deadline;
+}
+
+void FramePacer::wait(MeshSettings *mesh_set) {
+  mesh_set->target_fps = std::max(mesh_set->target_fps, 1);
+  if (mesh_set->pacing_mode != applied_mode) {
+    glfwSwapInterval(mesh_set->pacing_mode == PACING_VSYNC ? 1 : 0);
+    applied_mode = mesh_set->pacing_mode;
+    applied_fps = 0;
+    t_history = 0;
+    next = 0;
+  }
+  if (mesh_set->pacing_mode != PACING_LIMIT) return;
+
+  clock::duration period = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1.0 / mesh_set->target_fps));
+  clock::time_point now = clock::now();
+  if (applied_fps != mesh_set->target_fps) {
+    // fps novo: recomeca a contar daqui
+    applied_fps = mesh_set->target_fps;
+    deadline = now;
+    t_history = 0;
+    next = 0;
+  }
+  // prazo fixo a partir do anterior, sem acumular o atraso de cada frame;
+  // se ficou mais de um frame para tras nao tenta compensar
+  deadline += period;
+  if (deadline < now) deadline = now;
+
+  clock::time_point spin_from = deadline - std::chrono::duration_cast<clock::duration>(std::chrono::duration<double, std::milli>(PACING_SPIN_MS));
+  if (now < spin_from) std::this_thread::sleep_until(spin_from);
+  while (clock::now() < deadline);
+}
+
+void FramePacer::frame_end(MeshSettings *mesh_set) {
+  clock::time_point now = clock::now();
+  float ms = std::chrono::duration<float, std::milli>(now - last_frame).count();
+  last_frame = now;
+
+  history[next] = ms;
+  next = (next + 1) % PACING_HISTORY;
+  t_history = std::min<uint32_t>(t_history + 1, PACING_HISTORY);
+
+  float sum = 0.0f;
+  float worst = 0.0f;
+  for (uint32_t i = 0; i < t_history; i++) {
+    sum += history[i];
+    worst = std::max(worst, history[i]);
+  }
+  float mean = sum / t_history;
+  float var = 0.0f;
+  for (uint32_t i = 0; i < t_history; i++) var += (history[i] - mean) * (history[i] - mean);
+
+  mesh_set->pacing.frame_ms = mean;
+  mesh_set->pacing.jitter_ms = sqrtf(var / t_history);
+  mesh_set->pacing.worst_ms = worst;
+}
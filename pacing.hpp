@@ -0,0 +1,32 @@
+#ifndef PACING_H
+#define PACING_H
+
+#include "mesh.hpp"
+#include <chrono>
+
+#define PACING_SPIN_MS 1.5 // fim da espera em spin, o sleep do sistema acorda atrasado
+#define PACING_HISTORY 120 // frames usados no jitter
+
+// ritmo dos frames: vsync, limitador por fps alvo ou sem limite (--uncapped)
+class FramePacer
+{
+public:
+  FramePacer();
+  // antes do swap: troca o swap interval se o modo mudou e, no limitador,
+  // espera ate o prazo do frame (sleep e depois spin no relogio monotonico)
+  void wait(MeshSettings *mesh_set);
+  // depois do swap: intervalo entre frames completos, media, jitter e pior frame
+  void frame_end(MeshSettings *mesh_set);
+
+private:
+  typedef std::chrono::steady_clock clock;
+  int applied_mode;
+  int applied_fps;
+  clock::time_point deadline;
+  clock::time_point last_frame;
+  float history[PACING_HISTORY]; // ms por frame
+  uint32_t t_history;
+  uint32_t next;
+};
+
+#endif /* PACING_H */
@@ -0,0 +1,48 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <cstdint>
+#include <cstddef>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+inline uint32_t hardware_threads() {
+  uint32_t n = std::thread::hardware_concurrency();
+  return n == 0 ? 1 : n;
+}
+
+// teto de threads do parallel_for, 0: uma por nucleo (o mesh2-bench varre 1, 2, 4...)
+inline uint32_t &parallel_limit() {
+  static uint32_t limit = 0;
+  return limit;
+}
+
+// quantas faixas parallel_for vai usar para count itens
+inline uint32_t parallel_workers(size_t count, size_t min_grain) {
+  size_t max_workers = std::max<size_t>(1, count / std::max<size_t>(1, min_grain));
+  uint32_t threads = parallel_limit() > 0 ? std::min(parallel_limit(), hardware_threads()) : hardware_threads();
+  return (uint32_t)std::min<size_t>(threads, max_workers);
+}
+
+// divide [0, count) em ate parallel_workers() faixas de pelo menos min_grain
+// itens e chama fn(begin, end, worker) em cada uma, a faixa 0 roda na thread atual
+template <typename F>
+uint32_t parallel_for(size_t count, size_t min_grain, F fn) {
+  if (count == 0) return 0;
+  uint32_t workers = parallel_workers(count, min_grain);
+  size_t step = (count + workers - 1) / workers;
+
+  std::vector<std::thread> threads;
+  threads.reserve(workers);
+  for (uint32_t w = 1; w < workers; w++) {
+    size_t begin = std::min(count, w * step);
+    size_t end = std::min(count, begin + step);
+    threads.push_back(std::thread(fn, begin, end, w));
+  }
+  fn((size_t)0, std::min(count, step), (uint32_t)0);
+  for (size_t t = 0; t < threads.size(); t++) threads[t].join();
+  return workers;
+}
+
+#endif /* PARALLEL_H */
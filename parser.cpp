@@ -0,0 +1,335 @@
+#include "parser.hpp"
+#include "parallel.hpp"
+#include <cstring>
+#include <cerrno>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define MIN_CHUNK_BYTES (1 << 20)
+
+typedef struct {
+  std::vector<float> vertices;
+  std::vector<float> normals;
+  std::vector<float> texcoords;
+  std::vector<ObjIndex> indices;
+  // cantos com indice relativo (negativo), resolvidos no merge: canto * 3 + componente
+  std::vector<uint32_t> relative;
+} ObjChunk;
+
+static inline bool is_space(char c) {
+  return c == ' ' || c == '\t' || c == '\r';
+}
+
+// procura o proximo '\n' 16 bytes por vez
+static inline const char *find_newline(const char *p, const char *end) {
+#ifdef __SSE2__
+  const __m128i nl = _mm_set1_epi8('\n');
+  while (end - p >= 16) {
+    __m128i block = _mm_loadu_si128((const __m128i *)p);
+    int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, nl));
+    if (mask != 0) return p + __builtin_ctz(mask);
+    p += 16;
+  }
+#endif
+  const char *nl_pos = (const char *)memchr(p, '\n', end - p);
+  return nl_pos ? nl_pos : end;
+}
+
+static inline const char *skip_space(const char *p, const char *end) {
+  while (p < end && is_space(*p)) p++;
+  return p;
+}
+
+static const double pow10_table[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+static inline double pow10i(int e) {
+  double r = 1.0;
+  int a = e < 0 ? -e : e;
+  while (a > 22) {
+    r *= 1e22;
+    a -= 22;
+  }
+  r *= pow10_table[a];
+  return e < 0 ? 1.0 / r : r;
+}
+
+const char *ObjParser::parse_float(const char *p, const char *end, float *out) {
+  bool neg = false;
+  if (p < end && (*p == '-' || *p == '+')) {
+    neg = *p == '-';
+    p++;
+  }
+
+  uint64_t mantissa = 0;
+  int exp10 = 0;
+  int digits = 0;
+  while (p < end && (uint8_t)(*p - '0') < 10) {
+    if (digits < 19) {
+      mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+      digits += mantissa != 0;
+    } else {
+      exp10++;
+    }
+    p++;
+  }
+  if (p < end && *p == '.') {
+    p++;
+    while (p < end && (uint8_t)(*p - '0') < 10) {
+      if (digits < 19) {
+	mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+	digits += mantissa != 0;
+	exp10--;
+      }
+      p++;
+    }
+  }
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    const char *q = p + 1;
+    bool exp_neg = false;
+    if (q < end && (*q == '-' || *q == '+')) {
+      exp_neg = *q == '-';
+      q++;
+    }
+    if (q < end && (uint8_t)(*q - '0') < 10) {
+      int e = 0;
+      while (q < end && (uint8_t)(*q - '0') < 10) {
+	if (e < 10000) e = e * 10 + (*q - '0');
+	q++;
+      }
+      exp10 += exp_neg ? -e : e;
+      p = q;
+    }
+  }
+
+  double value = (double)mantissa;
+  if (exp10 != 0 && mantissa != 0) {
+    // divisao por potencia exata mantem o arredondamento correto no caso comum
+    if (exp10 < 0 && exp10 >= -22) value = value / pow10_table[-exp10];
+    else value = exp10 < -300 ? 0.0 : value * pow10i(exp10);
+  }
+  *out = (float)(neg ? -value : value);
+  return p;
+}
+
+static inline const char *parse_int(const char *p, const char *end, int *out) {
+  bool neg = false;
+  if (p < end && (*p == '-' || *p == '+')) {
+    neg = *p == '-';
+    p++;
+  }
+  int value = 0;
+  while (p < end && (uint8_t)(*p - '0') < 10) {
+    value = value * 10 + (*p - '0');
+    p++;
+  }
+  *out = neg ? -value : value;
+  return p;
+}
+
+// le ate n floats da linha, os que faltarem ficam em 0
+static inline const char *parse_floats(const char *p, const char *end, float *out, int n) {
+  for (int i = 0; i < n; i++) {
+    p = skip_space(p, end);
+    out[i] = 0.0f;
+    if (p < end) p = ObjParser::parse_float(p, end, &out[i]);
+  }
+  return p;
+}
+
+// converte o indice 1-based do obj, o negativo fica relativo ao inicio do pedaco
+static inline int resolve_index(int idx, size_t local_count, bool *relative) {
+  if (idx > 0) return idx - 1;
+  if (idx < 0) {
+    *relative = true;
+    return (int)local_count + idx;
+  }
+  return -1;
+}
+
+static void parse_face(const char *p, const char *end, ObjChunk *chunk) {
+  ObjIndex first = { -1, -1, -1 };
+  ObjIndex prev = first;
+  uint32_t first_rel = 0, prev_rel = 0;
+  uint32_t corners = 0;
+
+  while (true) {
+    p = skip_space(p, end);
+    if (p >= end || *p == '#') break;
+
+    ObjIndex idx = { -1, -1, -1 };
+    uint32_t rel = 0;
+    bool relative = false;
+    int v = 0;
+    p = parse_int(p, end, &v);
+    idx.vertex_index = resolve_index(v, chunk->vertices.size() / 3, &relative);
+    if (relative) rel |= 1;
+    if (p < end && *p == '/') {
+      p++;
+      if (p < end && *p != '/') {
+	relative = false;
+	p = parse_int(p, end, &v);
+	idx.texcoord_index = resolve_index(v, chunk->texcoords.size() / 2, &relative);
+	if (relative) rel |= 2;
+      }
+      if (p < end && *p == '/') {
+	p++;
+	relative = false;
+	p = parse_int(p, end, &v);
+	idx.normal_index = resolve_index(v, chunk->normals.size() / 3, &relative);
+	if (relative) rel |= 4;
+      }
+    }
+    // token invalido, pula ate o proximo espaco
+    while (p < end && !is_space(*p)) p++;
+
+    // triangulacao em leque: (0, i-1, i)
+    if (corners == 0) {
+      first = idx;
+      first_rel = rel;
+    } else if (corners >= 2) {
+      const ObjIndex tri[3] = { first, prev, idx };
+      const uint32_t tri_rel[3] = { first_rel, prev_rel, rel };
+      for (int c = 0; c < 3; c++) {
+	uint32_t corner = (uint32_t)chunk->indices.size();
+	chunk->indices.push_back(tri[c]);
+	for (uint32_t k = 0; k < 3; k++) {
+	  if (tri_rel[c] & (1u << k)) chunk->relative.push_back(corner * 3 + k);
+	}
+      }
+    }
+    prev = idx;
+    prev_rel = rel;
+    corners++;
+  }
+}
+
+static void parse_chunk(const char *p, const char *end, ObjChunk *chunk) {
+  // estimativa grosseira: ~32 bytes por linha
+  size_t lines = (end - p) / 32;
+  chunk->vertices.reserve(lines * 3 / 2);
+  chunk->indices.reserve(lines * 3 / 2);
+
+  while (p < end) {
+    const char *eol = find_newline(p, end);
+    const char *q = skip_space(p, eol);
+
+    if (eol - q >= 2) {
+      if (q[0] == 'v' && is_space(q[1])) {
+	float xyz[3];
+	parse_floats(q + 2, eol, xyz, 3);
+	chunk->vertices.insert(chunk->vertices.end(), xyz, xyz + 3);
+      } else if (q[0] == 'v' && q[1] == 'n' && eol - q > 2 && is_space(q[2])) {
+	float xyz[3];
+	parse_floats(q + 3, eol, xyz, 3);
+	chunk->normals.insert(chunk->normals.end(), xyz, xyz + 3);
+      } else if (q[0] == 'v' && q[1] == 't' && eol - q > 2 && is_space(q[2])) {
+	float uv[2];
+	parse_floats(q + 3, eol, uv, 2);
+	chunk->texcoords.insert(chunk->texcoords.end(), uv, uv + 2);
+      } else if (q[0] == 'f' && is_space(q[1])) {
+	parse_face(q + 2, eol, chunk);
+      }
+    }
+    p = eol + 1;
+  }
+}
+
+void ObjParser::parse_buffer(const char *begin, const char *end, ObjData *out,
+			     size_t vertex_base, size_t normal_base, size_t texcoord_base) {
+  size_t size = end - begin;
+  uint32_t n_chunks = parallel_workers(size, MIN_CHUNK_BYTES);
+
+  // limites dos pedacos avancados ate o fim da linha
+  std::vector<const char *> bounds(n_chunks + 1, end);
+  bounds[0] = begin;
+  for (uint32_t c = 1; c < n_chunks; c++) {
+    const char *p = std::max(bounds[c - 1], begin + size / n_chunks * c);
+    p = find_newline(p, end);
+    bounds[c] = p < end ? p + 1 : end;
+  }
+
+  std::vector<ObjChunk> chunks(n_chunks);
+  parallel_for(n_chunks, 1, [&](size_t b, size_t e, uint32_t) {
+    for (size_t c = b; c < e; c++) parse_chunk(bounds[c], bounds[c + 1], &chunks[c]);
+  });
+
+  // offsets globais de cada pedaco
+  std::vector<size_t> v_off(n_chunks + 1, 0), n_off(n_chunks + 1, 0), t_off(n_chunks + 1, 0), i_off(n_chunks + 1, 0);
+  for (uint32_t c = 0; c < n_chunks; c++) {
+    v_off[c + 1] = v_off[c] + chunks[c].vertices.size();
+    n_off[c + 1] = n_off[c] + chunks[c].normals.size();
+    t_off[c + 1] = t_off[c] + chunks[c].texcoords.size();
+    i_off[c + 1] = i_off[c] + chunks[c].indices.size();
+  }
+
+  out->vertices.resize(v_off[n_chunks]);
+  out->normals.resize(n_off[n_chunks]);
+  out->texcoords.resize(t_off[n_chunks]);
+  out->indices.resize(i_off[n_chunks]);
+
+  parallel_for(n_chunks, 1, [&](size_t b, size_t e, uint32_t) {
+    for (size_t c = b; c < e; c++) {
+      ObjChunk &chunk = chunks[c];
+      if (!chunk.vertices.empty()) memcpy(&out->vertices[v_off[c]], chunk.vertices.data(), chunk.vertices.size() * sizeof(float));
+      if (!chunk.normals.empty()) memcpy(&out->normals[n_off[c]], chunk.normals.data(), chunk.normals.size() * sizeof(float));
+      if (!chunk.texcoords.empty()) memcpy(&out->texcoords[t_off[c]], chunk.texcoords.data(), chunk.texcoords.size() * sizeof(float));
+
+      ObjIndex *dst = out->indices.data() + i_off[c];
+      if (!chunk.indices.empty()) memcpy(dst, chunk.indices.data(), chunk.indices.size() * sizeof(ObjIndex));
+      for (size_t r = 0; r < chunk.relative.size(); r++) {
+	uint32_t corner = chunk.relative[r] / 3;
+	switch (chunk.relative[r] % 3) {
+	case 0: dst[corner].vertex_index += (int)(vertex_base + v_off[c] / 3); break;
+	case 1: dst[corner].texcoord_index += (int)(texcoord_base + t_off[c] / 2); break;
+	case 2: dst[corner].normal_index += (int)(normal_base + n_off[c] / 3); break;
+	}
+      }
+      // cada pedaco sai da memoria assim que foi copiado, o pico nao dobra
+      std::vector<float>().swap(chunk.vertices);
+      std::vector<float>().swap(chunk.normals);
+      std::vector<float>().swap(chunk.texcoords);
+      std::vector<ObjIndex>().swap(chunk.indices);
+      std::vector<uint32_t>().swap(chunk.relative);
+    }
+  });
+}
+
+bool ObjParser::parse_file(const char *path, ObjData *out, std::string *err) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    *err = std::string("nao foi possivel abrir ") + path + ": " + strerror(errno);
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    *err = std::string("fstat falhou: ") + strerror(errno);
+    close(fd);
+    return false;
+  }
+  if (st.st_size == 0) {
+    close(fd);
+    return true;
+  }
+
+  void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    *err = std::string("mmap falhou: ") + strerror(errno);
+    return false;
+  }
+  madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+  const char *begin = (const char *)data;
+  parse_buffer(begin, begin + st.st_size, out);
+  munmap(data, st.st_size);
+  return true;
+}
@@ -0,0 +1,35 @@
+#ifndef PARSER_H
+#define PARSER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// mesmo layout do tinyobj::index_t, 0-based e -1 quando ausente
+typedef struct {
+  int vertex_index;
+  int normal_index;
+  int texcoord_index;
+} ObjIndex;
+
+typedef struct {
+  std::vector<float> vertices;   // x y z
+  std::vector<float> normals;    // x y z
+  std::vector<float> texcoords;  // u v
+  std::vector<ObjIndex> indices; // 3 cantos por triangulo
+} ObjData;
+
+class ObjParser
+{
+public:
+  // mapeia o arquivo e faz o parse em pedacos alinhados por linha, um por core
+  static bool parse_file(const char *path, ObjData *out, std::string *err);
+  // *_base: quantos v/vn/vt vieram antes do buffer, para resolver indices negativos
+  static void parse_buffer(const char *begin, const char *end, ObjData *out,
+			   size_t vertex_base = 0, size_t normal_base = 0, size_t texcoord_base = 0);
+  // parse de float sem strtod (independente de locale), retorna o fim do token
+  static const char *parse_float(const char *p, const char *end, float *out);
+};
+
+#endif /* PARSER_H */
@@ -0,0 +1,103 @@
+#include "png.hpp"
+#include <iostream>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+#include <cstdint>
+#include <zlib.h>
+
+static void put_u32(std::vector<uint8_t> *out, uint32_t v) {
+  out->push_back((uint8_t)(v >> 24));
+  out->push_back((uint8_t)(v >> 16));
+  out->push_back((uint8_t)(v >> 8));
+  out->push_back((uint8_t)v);
+}
+
+// tamanho, tipo, dados e crc do tipo + dados
+static void put_chunk(std::vector<uint8_t> *out, const char *type, const std::vector<uint8_t> &data) {
+  put_u32(out, (uint32_t)data.size());
+  size_t start = out->size();
+  out->insert(out->end(), type, type + 4);
+  out->insert(out->end(), data.begin(), data.end());
+  put_u32(out, (uint32_t)crc32(0, &(*out)[start], (uInt)(out->size() - start)));
+}
+
+static uint8_t paeth(uint8_t a, uint8_t b, uint8_t c) {
+  int p = a + b - c;
+  int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+  if (pa <= pb && pa <= pc) return a;
+  return pb <= pc ? b : c;
+}
+
+// os 5 filtros do PNG numa linha; fica o de menor soma dos bytes com sinal,
+// a heuristica da libpng. prev e nullptr na primeira linha
+static void filter_row(const uint8_t *row, const uint8_t *prev, size_t size, uint8_t *out, std::vector<uint8_t> *tmp) {
+  tmp->resize(size);
+  uint64_t best_sum = UINT64_MAX;
+  for (uint8_t f = 0; f < 5; f++) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < size; i++) {
+      uint8_t a = i >= 4 ? row[i - 4] : 0;
+      uint8_t b = prev ? prev[i] : 0;
+      uint8_t c = prev && i >= 4 ? prev[i - 4] : 0;
+      uint8_t v = row[i];
+      if (f == 1) v -= a;
+      else if (f == 2) v -= b;
+      else if (f == 3) v -= (uint8_t)((a + b) / 2);
+      else if (f == 4) v -= paeth(a, b, c);
+      (*tmp)[i] = v;
+      sum += v < 128 ? v : 256 - v;
+    }
+    if (sum < best_sum) {
+      best_sum = sum;
+      out[0] = f;
+      memcpy(out + 1, tmp->data(), size);
+    }
+  }
+}
+
+bool PngWriter::write(const char *path, uint32_t width, uint32_t height, const uint8_t *rgba) {
+  // cada linha comeca com o byte do filtro
+  size_t row = (size_t)width * 4;
+  std::vector<uint8_t> raw(height * (row + 1));
+  std::vector<uint8_t> tmp;
+  for (uint32_t y = 0; y < height; y++) {
+    filter_row(rgba + y * row, y > 0 ? rgba + (y - 1) * row : nullptr, row, &raw[y * (row + 1)], &tmp);
+  }
+
+  // zlib: cabecalho, deflate e adler32 dos dados
+  uLongf idat_size = compressBound(raw.size());
+  std::vector<uint8_t> idat(idat_size);
+  if (compress2(idat.data(), &idat_size, raw.data(), raw.size(), PNG_LEVEL) != Z_OK) {
+    std::cerr << "erro ao comprimir " << path << std::endl;
+    return false;
+  }
+  idat.resize(idat_size);
+
+  std::vector<uint8_t> ihdr;
+  put_u32(&ihdr, width);
+  put_u32(&ihdr, height);
+  ihdr.push_back(8); // bits por canal
+  ihdr.push_back(6); // RGBA
+  ihdr.push_back(0); // deflate
+  ihdr.push_back(0); // filtro adaptativo
+  ihdr.push_back(0); // sem entrelacamento
+
+  static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+  std::vector<uint8_t> png(signature, signature + 8);
+  put_chunk(&png, "IHDR", ihdr);
+  put_chunk(&png, "IDAT", idat);
+  put_chunk(&png, "IEND", std::vector<uint8_t>());
+
+  FILE *f = fopen(path, "wb");
+  if (f == nullptr) {
+    std::cerr << "nao foi possivel criar " << path << ": " << strerror(errno) << std::endl;
+    return false;
+  }
+  bool ok = fwrite(png.data(), 1, png.size(), f) == png.size();
+  ok = fclose(f) == 0 && ok;
+  if (!ok) std::cerr << "erro ao escrever " << path << ": " << strerror(errno) << std::endl;
+  return ok;
+}
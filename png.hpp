@@ -0,0 +1,18 @@
+#ifndef PNG_H
+#define PNG_H
+
+#include <cstdint>
+#include <cstddef>
+
+#define PNG_LEVEL 6 // nivel do deflate (zlib), o padrao: os encoders do --batch nao seguram o render
+
+// PNG RGBA8 com o filtro escolhido por linha e deflate da zlib, para as imagens
+// do --headless e do --batch
+class PngWriter
+{
+public:
+  // rgba com width * height pixels, a primeira linha e a de cima
+  static bool write(const char *path, uint32_t width, uint32_t height, const uint8_t *rgba);
+};
+
+#endif /* PNG_H */
@@ -0,0 +1,145 @@
+#include "profiler.hpp"
+#include <cstring>
+#include <algorithm>
+#include <GL/glew.h>
+
+Profiler::Profiler() : frames(0), t_spikes(0), dropped(0), last_spike(0), last_spike_ms(0.0f), last_spike_stage(-1), ready(false) {
+  memset(frame_ms, 0, sizeof(frame_ms));
+  memset(spike, 0, sizeof(spike));
+  memset(issued, 0, sizeof(issued));
+  memset(stage_cpu, 0, sizeof(stage_cpu));
+  for (int i = 0; i < PROFILER_HISTORY; i++) gpu_ms[i] = -1.0f;
+  for (int s = 0; s < STAGE_COUNT; s++) for (int i = 0; i < PROFILER_HISTORY; i++) stage_gpu[s][i] = -1.0f;
+}
+
+Profiler::~Profiler() {
+  if (ready) glDeleteQueries(sizeof(queries) / sizeof(uint32_t), &queries[0][0][0]);
+}
+
+void Profiler::init() {
+  glGenQueries(sizeof(queries) / sizeof(uint32_t), &queries[0][0][0]);
+  ready = true;
+}
+
+const char *Profiler::stage_name(int stage) {
+  static const char *names[STAGE_COUNT] = { "entrada", "imgui (paineis)", "upload", "uniforms", "draw", "imgui (render)", "espera", "swap", "eventos" };
+  return stage >= 0 && stage < STAGE_COUNT ? names[stage] : "?";
+}
+
+uint32_t Profiler::history_count() const {
+  return (uint32_t)std::min<uint64_t>(frames, PROFILER_HISTORY);
+}
+
+uint32_t Profiler::history_offset() const {
+  return frames < PROFILER_HISTORY ? 0 : (uint32_t)(frames % PROFILER_HISTORY);
+}
+
+void Profiler::collect(uint32_t slot) {
+  uint64_t f = slot_frame[slot];
+  // os timestamps terminam em ordem: o ultimo do frame pronto, todos prontos
+  GLint available = 0;
+  glGetQueryObjectiv(queries[slot][STAGE_COUNT][1], GL_QUERY_RESULT_AVAILABLE, &available);
+  if (!available) {
+    dropped++;
+    return;
+  }
+  uint32_t idx = f % PROFILER_HISTORY;
+  for (int s = 0; s <= STAGE_COUNT; s++) {
+    if (!issued[slot][s]) continue;
+    GLuint64 t0 = 0, t1 = 0;
+    glGetQueryObjectui64v(queries[slot][s][0], GL_QUERY_RESULT, &t0);
+    glGetQueryObjectui64v(queries[slot][s][1], GL_QUERY_RESULT, &t1);
+    float ms = t1 > t0 ? (float)((t1 - t0) / 1.0e6) : 0.0f;
+    if (s == STAGE_COUNT) {
+      gpu_ms[idx] = ms;
+    } else {
+      stage_gpu[s][idx] = ms;
+    }
+  }
+}
+
+void Profiler::frame_begin() {
+  uint32_t slot = frames % (PROFILER_LATENCY + 1);
+  uint32_t idx = frames % PROFILER_HISTORY;
+  if (ready && frames > PROFILER_LATENCY) collect(slot);
+
+  memset(issued[slot], 0, sizeof(issued[slot]));
+  slot_frame[slot] = frames;
+  for (int s = 0; s < STAGE_COUNT; s++) {
+    stage_cpu[s][idx] = 0.0f;
+    stage_gpu[s][idx] = -1.0f;
+  }
+  gpu_ms[idx] = -1.0f;
+  spike[idx] = false;
+
+  frame_start = clock::now();
+  if (ready) {
+    glQueryCounter(queries[slot][STAGE_COUNT][0], GL_TIMESTAMP);
+    issued[slot][STAGE_COUNT] = true;
+  }
+}
+
+void Profiler::begin(int stage) {
+  uint32_t slot = frames % (PROFILER_LATENCY + 1);
+  stage_start[stage] = clock::now();
+  if (ready && !issued[slot][stage]) {
+    glQueryCounter(queries[slot][stage][0], GL_TIMESTAMP);
+    issued[slot][stage] = true;
+  }
+}
+
+void Profiler::end(int stage) {
+  uint32_t slot = frames % (PROFILER_LATENCY + 1);
+  stage_cpu[stage][frames % PROFILER_HISTORY] += std::chrono::duration<float, std::milli>(clock::now() - stage_start[stage]).count();
+  if (ready) glQueryCounter(queries[slot][stage][1], GL_TIMESTAMP);
+}
+
+void Profiler::frame_end() {
+  uint32_t slot = frames % (PROFILER_LATENCY + 1);
+  uint32_t idx = frames % PROFILER_HISTORY;
+  if (ready) glQueryCounter(queries[slot][STAGE_COUNT][1], GL_TIMESTAMP);
+  frame_ms[idx] = std::chrono::duration<float, std::milli>(clock::now() - frame_start).count();
+
+  // pico contra a media do historico, sem o frame atual
+  uint32_t count = history_count();
+  if (frames >= PROFILER_SPIKE_WARMUP && count > 1) {
+    float sum = 0.0f;
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < count; i++) {
+      if (i == idx) continue;
+      sum += frame_ms[i];
+      n++;
+    }
+    float avg = sum / n;
+    if (frame_ms[idx] > PROFILER_SPIKE * avg) {
+      spike[idx] = true;
+      t_spikes++;
+      last_spike = frames;
+      last_spike_ms = frame_ms[idx];
+      last_spike_stage = 0;
+      for (int s = 1; s < STAGE_COUNT; s++) {
+	if (stage_cpu[s][idx] > stage_cpu[last_spike_stage][idx]) last_spike_stage = s;
+      }
+    }
+  }
+  frames++;
+}
+
+void Profiler::stage_stats(int stage, float *cpu_avg, float *cpu_max, float *gpu_avg, float *gpu_max) const {
+  uint32_t count = history_count();
+  float cpu_sum = 0.0f, gpu_sum = 0.0f;
+  uint32_t t_gpu = 0;
+  *cpu_max = 0.0f;
+  *gpu_max = -1.0f;
+  for (uint32_t i = 0; i < count; i++) {
+    cpu_sum += stage_cpu[stage][i];
+    *cpu_max = std::max(*cpu_max, stage_cpu[stage][i]);
+    if (stage_gpu[stage][i] >= 0.0f) {
+      gpu_sum += stage_gpu[stage][i];
+      *gpu_max = std::max(*gpu_max, stage_gpu[stage][i]);
+      t_gpu++;
+    }
+  }
+  *cpu_avg = count ? cpu_sum / count : 0.0f;
+  *gpu_avg = t_gpu ? gpu_sum / t_gpu : -1.0f;
+}
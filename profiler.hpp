@@ -0,0 +1,89 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <cstdint>
+#include <chrono>
+
+#define PROFILER_LATENCY 4      // frames ate ler as queries de volta, sem esperar a GPU
+#define PROFILER_HISTORY 240    // frames no grafico e nas medias
+#define PROFILER_SPIKE 2.0f     // frame acima de 2x a media vira pico
+#define PROFILER_SPIKE_WARMUP 30 // frames antes de comecar a marcar picos
+
+enum PROFILE_STAGE {
+  STAGE_INPUT = 0,     // teclado e mouse
+  STAGE_IMGUI_BUILD,   // NewFrame, os paineis e a ajuda
+  STAGE_UPLOAD,        // stream, uv gerado e instancias
+  STAGE_UNIFORMS,      // uniform blocks e matriz de modelo
+  STAGE_DRAW,          // glDraw* da malha
+  STAGE_IMGUI_RENDER,  // Render e RenderDrawData
+  STAGE_WAIT,          // espera do FramePacer
+  STAGE_SWAP,
+  STAGE_POLL,          // glfwPollEvents
+  STAGE_COUNT,
+};
+
+// tempos de CPU e de GPU (GL_TIMESTAMP dentro do frame) por etapa; as queries
+// de um frame sao lidas PROFILER_LATENCY frames depois, ou descartadas se a GPU
+// ainda nao chegou nelas. Cada etapa tem um begin e um end por frame: na GPU
+// ela vai do primeiro begin ao ultimo end e cobriria as etapas do meio
+class Profiler
+{
+public:
+  Profiler();
+  ~Profiler();
+  // gera as queries, precisa do contexto GL atual
+  void init();
+  void frame_begin();
+  void frame_end();
+  void begin(int stage);
+  void end(int stage);
+
+  static const char *stage_name(int stage);
+  // media e maximo no historico, GPU negativo quando nenhum frame chegou
+  void stage_stats(int stage, float *cpu_avg, float *cpu_max, float *gpu_avg, float *gpu_max) const;
+
+  // historico em anel, o mais antigo em history_offset()
+  float frame_ms[PROFILER_HISTORY]; // CPU, do frame_begin ao frame_end
+  float gpu_ms[PROFILER_HISTORY];   // do primeiro ao ultimo timestamp do frame, -1 sem resultado
+  bool spike[PROFILER_HISTORY];
+  uint32_t history_count() const;
+  uint32_t history_offset() const;
+  uint64_t frames;
+  uint32_t t_spikes;
+  uint32_t dropped;        // frames cujas queries nao tinham chegado a tempo
+  uint64_t last_spike;     // frame do ultimo pico
+  float last_spike_ms;
+  int last_spike_stage;    // etapa com mais CPU no ultimo pico
+
+private:
+  typedef std::chrono::steady_clock clock;
+  void collect(uint32_t slot);
+
+  // [frame em voo][etapa + frame inteiro][inicio, fim]
+  uint32_t queries[PROFILER_LATENCY + 1][STAGE_COUNT + 1][2];
+  bool issued[PROFILER_LATENCY + 1][STAGE_COUNT + 1];
+  uint64_t slot_frame[PROFILER_LATENCY + 1];
+  bool ready;
+  clock::time_point frame_start;
+  clock::time_point stage_start[STAGE_COUNT];
+  float stage_cpu[STAGE_COUNT][PROFILER_HISTORY];
+  float stage_gpu[STAGE_COUNT][PROFILER_HISTORY];
+};
+
+// marca uma etapa ate o fim do escopo; nao faz nada sem profiler
+class ProfileScope
+{
+public:
+  ProfileScope(Profiler *profiler, int stage) : profiler(profiler), stage(stage) {
+    if (profiler != nullptr) profiler->begin(stage);
+  }
+  ~ProfileScope() {
+    if (profiler != nullptr) profiler->end(stage);
+  }
+
+private:
+  Profiler *profiler;
+  int stage;
+};
+
+#endif /* PROFILER_H */
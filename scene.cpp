@@ -0,0 +1,130 @@
+#include "scene.hpp"
+#include "cache.hpp"
+#include "parallel.hpp"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <cstring>
+#include <cerrno>
+#include <cfloat>
+#include <glm/ext/matrix_transform.hpp> // glm::translate, glm::scale
+
+std::vector<SceneEntry> SceneLoader::read_manifest(const char *path) {
+  std::ifstream in(path);
+  if (!in) {
+    std::cerr << "nao foi possivel abrir o manifesto " << path << ": " << strerror(errno) << std::endl;
+    exit(1);
+  }
+  std::string dir = path;
+  size_t slash = dir.find_last_of('/');
+  dir = slash == std::string::npos ? "" : dir.substr(0, slash + 1);
+
+  std::vector<SceneEntry> entries;
+  std::string line;
+  for (int n = 1; std::getline(in, line); n++) {
+    size_t comment = line.find('#');
+    if (comment != std::string::npos) line.resize(comment);
+    std::istringstream fields(line);
+    SceneEntry entry;
+    entry.offset = glm::vec3(0.0f);
+    entry.scale = 1.0f;
+    if (!(fields >> entry.obj_file)) continue; // linha vazia
+    if (fields >> entry.offset.x) {
+      if (!(fields >> entry.offset.y >> entry.offset.z)) {
+	std::cerr << path << ":" << n << ": esperava \"caminho.obj [x y z [escala]]\"" << std::endl;
+	exit(1);
+      }
+      if (!(fields >> entry.scale)) entry.scale = 1.0f;
+    }
+    if (entry.obj_file[0] != '/') entry.obj_file = dir + entry.obj_file;
+    entries.push_back(entry);
+  }
+  if (entries.empty()) {
+    std::cerr << "manifesto " << path << " sem nenhuma malha." << std::endl;
+    exit(1);
+  }
+  return entries;
+}
+
+MeshSettings SceneLoader::load(const char *name, const std::vector<SceneEntry> &entries, const LoadOptions &opts) {
+  auto load_start = std::chrono::steady_clock::now();
+  size_t t_parts = entries.size();
+
+  // uma parte por vez em cada thread, o parse de um .obj grande ainda se divide por dentro
+  std::vector<MeshSettings> parts(t_parts);
+  parallel_for(t_parts, 1, [&](size_t begin, size_t end, uint32_t) {
+    for (size_t i = begin; i < end; i++) parts[i] = ObjLoader::load_file(entries[i].obj_file.c_str(), nullptr, opts);
+  });
+
+  // caixa da cena: cantos de cada parte levados para as unidades do manifesto
+  std::vector<glm::mat4> to_scene(t_parts);
+  glm::vec3 scene_min = glm::vec3(FLT_MAX);
+  glm::vec3 scene_max = glm::vec3(-FLT_MAX);
+  for (size_t i = 0; i < t_parts; i++) {
+    const MeshSettings &p = parts[i];
+    // normalizado da parte -> coordenadas do .obj -> posicao no manifesto
+    glm::mat4 m = glm::translate(glm::mat4(1.0f), entries[i].offset);
+    m = glm::scale(m, glm::vec3(entries[i].scale));
+    m = glm::translate(m, p.center);
+    m = glm::scale(m, glm::vec3(1.0f / p.escala));
+    to_scene[i] = m;
+    for (int k = 0; k < 8; k++) {
+      glm::vec3 corner = glm::vec3(k & 1 ? p.bbox_max.x : p.bbox_min.x,
+				   k & 2 ? p.bbox_max.y : p.bbox_min.y,
+				   k & 4 ? p.bbox_max.z : p.bbox_min.z);
+      glm::vec3 w = glm::vec3(m * glm::vec4(corner, 1.0f));
+      scene_min = glm::min(scene_min, w);
+      scene_max = glm::max(scene_max, w);
+    }
+  }
+
+  glm::vec3 center = (scene_min + scene_max) / 2.0f;
+  glm::vec3 tam = scene_max - scene_min;
+  float maior_dim = std::max(std::max(tam.x, tam.y), tam.z);
+  float escala = maior_dim > 0.0f ? 1.0f / maior_dim : 1.0f;
+  glm::mat4 normalize = glm::scale(glm::mat4(1.0f), glm::vec3(escala));
+  normalize = glm::translate(normalize, -center);
+
+  // sub-alocacao: cada parte e uma faixa do VBO e do EBO, com indices locais
+  MeshSettings scene = ObjLoader::make_settings(name, nullptr);
+  uint64_t t_verts = 0;
+  uint64_t t_index = 0;
+  for (size_t i = 0; i < t_parts; i++) {
+    const MeshSettings &p = parts[i];
+    scene.parts.push_back((MeshPart){
+	.obj_file = entries[i].obj_file,
+	.base_vertex = t_verts,
+	.first_index = t_index,
+	.t_index = mesh_base_index_count(&p),
+	.transform = normalize * to_scene[i],
+	.bbox_min = p.bbox_min,
+	.bbox_max = p.bbox_max,
+      });
+    t_verts += p.t_verts;
+    t_index += mesh_base_index_count(&p);
+    scene.has_texcoords = scene.has_texcoords || p.has_texcoords;
+  }
+
+  scene.vertices.resize(t_verts);
+  scene.indices.resize(t_index);
+  parallel_for(t_parts, 1, [&](size_t begin, size_t end, uint32_t) {
+    for (size_t i = begin; i < end; i++) {
+      const MeshPart &part = scene.parts[i];
+      memcpy(&scene.vertices[part.base_vertex], mesh_vertex_data(&parts[i]), parts[i].t_verts * sizeof(Vertex));
+      memcpy(&scene.indices[part.first_index], mesh_index_data(&parts[i]), part.t_index * sizeof(uint32_t));
+      MeshCache::unmap(&parts[i]);
+    }
+  });
+
+  scene.t_verts = t_verts;
+  scene.t_index = t_index;
+  scene.center = center;
+  scene.escala = escala;
+  scene.bbox_min = (scene_min - center) * escala;
+  scene.bbox_max = (scene_max - center) * escala;
+
+  std::cout << "cena: " << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - load_start).count()
+	    << " ms (" << t_parts << " partes, " << t_verts << " vertices, " << t_index / 3 << " triangulos)" << std::endl;
+  return scene;
+}
@@ -0,0 +1,25 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include "mesh.hpp"
+#include "obj.hpp"
+#include <string>
+
+// uma linha do manifesto: "caminho.obj [x y z [escala]]"
+typedef struct {
+  std::string obj_file;
+  glm::vec3 offset; // posicao da parte, nas unidades do .obj
+  float scale;
+} SceneEntry;
+
+// --scene: varias malhas numa sessao, todas num VBO/EBO so
+class SceneLoader
+{
+public:
+  // caminhos relativos sao resolvidos a partir do diretorio do manifesto
+  static std::vector<SceneEntry> read_manifest(const char *path);
+  // carrega as partes em paralelo (cada uma pelo load_file, com cache) e junta os buffers
+  static MeshSettings load(const char *name, const std::vector<SceneEntry> &entries, const LoadOptions &opts);
+};
+
+#endif /* SCENE_H */
@@ -0,0 +1,288 @@
+#include "simplify.hpp"
+#include "optimize.hpp"
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+
+#define BORDER_WEIGHT 10.0 // peso dos planos que prendem as bordas abertas
+
+// matriz simetrica 4x4 do erro quadrico, w = area acumulada das faces
+typedef struct {
+  double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+  double w;
+} Quadric;
+
+typedef struct {
+  float cost;    // distancia media aos planos, na escala da malha normalizada
+  uint32_t from; // colapsa from sobre to
+  uint32_t to;
+} Collapse;
+
+typedef struct {
+  uint64_t edge; // menor << 32 | maior
+  uint32_t tri;
+} EdgeRef;
+
+static void quadric_add_plane(Quadric *q, glm::dvec3 n, double d, double w) {
+  q->a2 += w * n.x * n.x; q->ab += w * n.x * n.y; q->ac += w * n.x * n.z; q->ad += w * n.x * d;
+  q->b2 += w * n.y * n.y; q->bc += w * n.y * n.z; q->bd += w * n.y * d;
+  q->c2 += w * n.z * n.z; q->cd += w * n.z * d;
+  q->d2 += w * d * d;
+}
+
+static void quadric_add(Quadric *q, const Quadric &o) {
+  q->a2 += o.a2; q->ab += o.ab; q->ac += o.ac; q->ad += o.ad;
+  q->b2 += o.b2; q->bc += o.bc; q->bd += o.bd;
+  q->c2 += o.c2; q->cd += o.cd;
+  q->d2 += o.d2;
+  q->w += o.w;
+}
+
+static double quadric_error(const Quadric &q, const Quadric &o, glm::vec3 p) {
+  double x = p.x, y = p.y, z = p.z;
+  double e = (q.a2 + o.a2) * x * x + 2.0 * (q.ab + o.ab) * x * y + 2.0 * (q.ac + o.ac) * x * z + 2.0 * (q.ad + o.ad) * x
+    + (q.b2 + o.b2) * y * y + 2.0 * (q.bc + o.bc) * y * z + 2.0 * (q.bd + o.bd) * y
+    + (q.c2 + o.c2) * z * z + 2.0 * (q.cd + o.cd) * z
+    + (q.d2 + o.d2);
+  return sqrt(fabs(e) / std::max(q.w + o.w, 1e-12));
+}
+
+static glm::vec3 vertex_pos(const std::vector<Vertex> &verts, uint32_t v) {
+  return glm::vec3(verts[v].position);
+}
+
+// depois de mover from para to os triangulos em volta de from nao podem virar
+static bool collapse_flips(const std::vector<Vertex> &verts, const std::vector<uint32_t> &tris,
+			   const std::vector<uint32_t> &adj_offsets, const std::vector<uint32_t> &adjacency,
+			   uint32_t from, uint32_t to) {
+  glm::vec3 target = vertex_pos(verts, to);
+  for (uint32_t a = adj_offsets[from]; a < adj_offsets[from + 1]; a++) {
+    const uint32_t *tri = &tris[3 * adjacency[a]];
+    if (tri[0] == to || tri[1] == to || tri[2] == to) continue; // vai sumir
+    glm::vec3 p[3], q[3];
+    for (int c = 0; c < 3; c++) {
+      p[c] = vertex_pos(verts, tri[c]);
+      q[c] = tri[c] == from ? target : p[c];
+    }
+    glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+    glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+    if (glm::dot(before, after) <= 0.0f) return true;
+  }
+  return false;
+}
+
+void MeshSimplifier::position_ids(const std::vector<Vertex> &verts, std::vector<uint32_t> *ids) {
+  size_t t_verts = verts.size();
+  std::vector<uint32_t> by_pos(t_verts);
+  for (size_t v = 0; v < t_verts; v++) by_pos[v] = (uint32_t)v;
+  std::sort(by_pos.begin(), by_pos.end(), [&](uint32_t a, uint32_t b) {
+    const glm::vec4 &pa = verts[a].position;
+    const glm::vec4 &pb = verts[b].position;
+    if (pa.x != pb.x) return pa.x < pb.x;
+    if (pa.y != pb.y) return pa.y < pb.y;
+    if (pa.z != pb.z) return pa.z < pb.z;
+    return a < b;
+  });
+  ids->resize(t_verts);
+  for (size_t i = 0; i < t_verts; i++) {
+    bool same = i > 0 && glm::vec3(verts[by_pos[i]].position) == glm::vec3(verts[by_pos[i - 1]].position);
+    (*ids)[by_pos[i]] = same ? (*ids)[by_pos[i - 1]] : by_pos[i];
+  }
+}
+
+void MeshSimplifier::simplify(const uint32_t *indices, size_t t_index, const std::vector<Vertex> &verts,
+			      size_t target_index, float max_error, std::vector<uint32_t> *out) {
+  size_t t_verts = verts.size();
+
+  // vertices com a mesma posicao (costuras de normal/vt) viram um so na topologia
+  std::vector<uint32_t> pos_id;
+  MeshSimplifier::position_ids(verts, &pos_id);
+  std::vector<uint32_t> canon(pos_id);
+
+  std::vector<uint32_t> tris(t_index);
+  std::vector<uint32_t> corners(indices, indices + t_index); // vertice original de cada canto
+  for (size_t i = 0; i < t_index; i++) tris[i] = canon[indices[i]];
+
+  // quadricas dos planos das faces, ponderadas pela area
+  std::vector<Quadric> quadrics(t_verts);
+  for (size_t v = 0; v < t_verts; v++) quadrics[v] = (Quadric){ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+  std::vector<EdgeRef> edges;
+  edges.reserve(t_index);
+  for (size_t t = 0; t < t_index / 3; t++) {
+    const uint32_t *tri = &tris[3 * t];
+    glm::dvec3 p0 = glm::dvec3(vertex_pos(verts, tri[0]));
+    glm::dvec3 p1 = glm::dvec3(vertex_pos(verts, tri[1]));
+    glm::dvec3 p2 = glm::dvec3(vertex_pos(verts, tri[2]));
+    glm::dvec3 n = glm::cross(p1 - p0, p2 - p0);
+    double len = glm::length(n);
+    if (len > 0.0) {
+      n /= len;
+      for (int c = 0; c < 3; c++) {
+	quadric_add_plane(&quadrics[tri[c]], n, -glm::dot(n, p0), len * 0.5);
+	quadrics[tri[c]].w += len * 0.5;
+      }
+    }
+    for (int c = 0; c < 3; c++) {
+      uint32_t a = tri[c], b = tri[(c + 1) % 3];
+      if (a == b) continue;
+      edges.push_back((EdgeRef){ .edge = ((uint64_t)std::min(a, b) << 32) | std::max(a, b), .tri = (uint32_t)t });
+    }
+  }
+
+  // arestas de um triangulo so sao borda: plano perpendicular a face passando pela aresta
+  std::sort(edges.begin(), edges.end(), [](const EdgeRef &a, const EdgeRef &b) { return a.edge < b.edge; });
+  for (size_t i = 0; i < edges.size(); i++) {
+    bool border = (i == 0 || edges[i - 1].edge != edges[i].edge) && (i + 1 == edges.size() || edges[i + 1].edge != edges[i].edge);
+    if (!border) continue;
+    uint32_t a = (uint32_t)(edges[i].edge >> 32), b = (uint32_t)edges[i].edge;
+    const uint32_t *tri = &tris[3 * edges[i].tri];
+    glm::dvec3 p0 = glm::dvec3(vertex_pos(verts, tri[0]));
+    glm::dvec3 face = glm::cross(glm::dvec3(vertex_pos(verts, tri[1])) - p0, glm::dvec3(vertex_pos(verts, tri[2])) - p0);
+    glm::dvec3 pa = glm::dvec3(vertex_pos(verts, a));
+    glm::dvec3 ab = glm::dvec3(vertex_pos(verts, b)) - pa;
+    glm::dvec3 n = glm::cross(ab, face);
+    double len = glm::length(n);
+    if (len == 0.0) continue;
+    n /= len;
+    double w = BORDER_WEIGHT * glm::dot(ab, ab);
+    quadric_add_plane(&quadrics[a], n, -glm::dot(n, pa), w);
+    quadric_add_plane(&quadrics[b], n, -glm::dot(n, pa), w);
+  }
+  std::vector<EdgeRef>().swap(edges);
+
+  std::vector<uint32_t> adj_offsets(t_verts + 1);
+  std::vector<uint32_t> adjacency;
+  std::vector<uint64_t> unique_edges;
+  std::vector<Collapse> collapses;
+  std::vector<uint8_t> locked(t_verts);
+  target_index -= target_index % 3;
+
+  for (int pass = 0; pass < SIMPLIFY_MAX_PASSES && tris.size() > target_index; pass++) {
+    // triangulos de cada vertice (CSR) para o teste de virada
+    std::fill(adj_offsets.begin(), adj_offsets.end(), 0);
+    for (size_t i = 0; i < tris.size(); i++) adj_offsets[tris[i] + 1]++;
+    for (size_t v = 0; v < t_verts; v++) adj_offsets[v + 1] += adj_offsets[v];
+    adjacency.resize(tris.size());
+    {
+      std::vector<uint32_t> cursor(adj_offsets.begin(), adj_offsets.end() - 1);
+      for (size_t i = 0; i < tris.size(); i++) adjacency[cursor[tris[i]]++] = (uint32_t)(i / 3);
+    }
+
+    unique_edges.clear();
+    for (size_t t = 0; t < tris.size() / 3; t++) {
+      for (int c = 0; c < 3; c++) {
+	uint32_t a = tris[3*t+c], b = tris[3*t+(c+1)%3];
+	unique_edges.push_back(((uint64_t)std::min(a, b) << 32) | std::max(a, b));
+      }
+    }
+    std::sort(unique_edges.begin(), unique_edges.end());
+    unique_edges.erase(std::unique(unique_edges.begin(), unique_edges.end()), unique_edges.end());
+
+    // custo de cada aresta no sentido mais barato
+    collapses.clear();
+    for (size_t e = 0; e < unique_edges.size(); e++) {
+      uint32_t a = (uint32_t)(unique_edges[e] >> 32), b = (uint32_t)unique_edges[e];
+      double to_b = quadric_error(quadrics[a], quadrics[b], vertex_pos(verts, b));
+      double to_a = quadric_error(quadrics[a], quadrics[b], vertex_pos(verts, a));
+      if (to_b <= to_a) collapses.push_back((Collapse){ .cost = (float)to_b, .from = a, .to = b });
+      else collapses.push_back((Collapse){ .cost = (float)to_a, .from = b, .to = a });
+    }
+    std::sort(collapses.begin(), collapses.end(), [](const Collapse &a, const Collapse &b) { return a.cost < b.cost; });
+
+    // colapsos independentes: trava o anel de quem colapsa, o teste de virada continua valido
+    std::fill(locked.begin(), locked.end(), 0);
+    size_t needed = (tris.size() - target_index) / 3;
+    size_t removed = 0;
+    size_t done = 0;
+    for (size_t k = 0; k < collapses.size() && removed < needed; k++) {
+      if (collapses[k].cost > max_error) break;
+      uint32_t from = collapses[k].from, to = collapses[k].to;
+      if (locked[from] || locked[to]) continue;
+      if (collapse_flips(verts, tris, adj_offsets, adjacency, from, to)) continue;
+
+      for (uint32_t a = adj_offsets[from]; a < adj_offsets[from + 1]; a++) {
+	const uint32_t *tri = &tris[3 * adjacency[a]];
+	if (tri[0] == to || tri[1] == to || tri[2] == to) removed++;
+	for (int c = 0; c < 3; c++) locked[tri[c]] = 1;
+      }
+      locked[to] = 1;
+      quadric_add(&quadrics[to], quadrics[from]);
+      // marca o colapso em canon: from deixa de ser canonico
+      canon[from] = to;
+      done++;
+    }
+    if (done == 0) break;
+
+    // reescreve os triangulos e descarta os degenerados
+    size_t kept = 0;
+    for (size_t t = 0; t < tris.size() / 3; t++) {
+      uint32_t v[3];
+      for (int c = 0; c < 3; c++) {
+	v[c] = tris[3*t+c];
+	if (canon[v[c]] != v[c]) v[c] = canon[v[c]];
+      }
+      if (v[0] == v[1] || v[1] == v[2] || v[0] == v[2]) continue;
+      for (int c = 0; c < 3; c++) {
+	tris[3*kept+c] = v[c];
+	corners[3*kept+c] = corners[3*t+c];
+      }
+      kept++;
+    }
+    tris.resize(3 * kept);
+    corners.resize(3 * kept);
+  }
+
+  // cantos que mudaram de posicao pegam o vertice do destino com atributos mais parecidos
+  // (mesma normal/vt do lado certo da costura)
+  std::vector<uint32_t> group_offsets(t_verts + 1, 0);
+  std::vector<uint32_t> group(t_verts);
+  {
+    for (size_t v = 0; v < t_verts; v++) group_offsets[pos_id[v] + 1]++;
+    for (size_t v = 0; v < t_verts; v++) group_offsets[v + 1] += group_offsets[v];
+    std::vector<uint32_t> cursor(group_offsets.begin(), group_offsets.end() - 1);
+    for (size_t v = 0; v < t_verts; v++) group[cursor[pos_id[v]]++] = (uint32_t)v;
+  }
+
+  out->resize(tris.size());
+  for (size_t i = 0; i < tris.size(); i++) {
+    uint32_t orig = corners[i];
+    uint32_t pos = tris[i];
+    if (glm::vec3(verts[orig].position) == glm::vec3(verts[pos].position)) {
+      (*out)[i] = orig;
+      continue;
+    }
+    uint32_t best = pos;
+    float best_score = -FLT_MAX;
+    for (uint32_t g = group_offsets[pos]; g < group_offsets[pos + 1]; g++) {
+      const Vertex &cand = verts[group[g]];
+      glm::vec2 duv = cand.texcoord - verts[orig].texcoord;
+      float score = glm::dot(cand.normal, verts[orig].normal) - glm::dot(duv, duv);
+      if (score > best_score) {
+	best_score = score;
+	best = group[g];
+      }
+    }
+    (*out)[i] = best;
+  }
+}
+
+void MeshSimplifier::build_lods(std::vector<uint32_t> *indices, const std::vector<Vertex> &verts, bool optimize,
+				std::vector<MeshLod> *lods) {
+  size_t base = indices->size();
+  lods->clear();
+  lods->push_back((MeshLod){ .offset = 0, .count = base });
+
+  std::vector<uint32_t> lod;
+  for (int level = 1; level < LOD_LEVELS; level++) {
+    const MeshLod &prev = lods->back();
+    size_t target = base >> level;
+    if (target < 3) break;
+    float max_error = LOD_MAX_ERROR * (float)(1 << (level - 1));
+    MeshSimplifier::simplify(indices->data() + prev.offset, prev.count, verts, target, max_error, &lod);
+    // nao reduziu o bastante (malha ja muito simples ou toda travada): para a cadeia
+    if (lod.empty() || lod.size() > prev.count * 9 / 10) break;
+    if (optimize) MeshOptimizer::optimize_vertex_cache(&lod, verts.size());
+    lods->push_back((MeshLod){ .offset = indices->size(), .count = lod.size() });
+    indices->insert(indices->end(), lod.begin(), lod.end());
+  }
+}
@@ -0,0 +1,26 @@
+#ifndef SIMPLIFY_H
+#define SIMPLIFY_H
+
+#include "mesh.hpp"
+
+#define LOD_LEVELS 4              // LOD0 completa + 3 niveis com metade dos triangulos cada
+#define LOD_FULL_PIXELS 256.0f    // raio projetado (px) a partir do qual desenha a LOD0
+#define LOD_MAX_ERROR 0.01f       // erro da LOD1 (malha normalizada tem maior dimensao 1), dobra por nivel
+#define SIMPLIFY_MAX_PASSES 64
+
+// simplificacao por colapso de arestas com erro quadrico (Garland-Heckbert),
+// os vertices so colapsam sobre vertices existentes: todas as LODs usam o mesmo VBO
+class MeshSimplifier
+{
+public:
+  // ids[v] = menor vertice com a mesma posicao de v
+  static void position_ids(const std::vector<Vertex> &verts, std::vector<uint32_t> *ids);
+  // reduz indices[0..t_index) para perto de target_index indices sem passar de max_error
+  static void simplify(const uint32_t *indices, size_t t_index, const std::vector<Vertex> &verts,
+		       size_t target_index, float max_error, std::vector<uint32_t> *out);
+  // anexa as LODs ao fim de indices, lods[0] e a malha original
+  static void build_lods(std::vector<uint32_t> *indices, const std::vector<Vertex> &verts, bool optimize,
+			 std::vector<MeshLod> *lods);
+};
+
+#endif /* SIMPLIFY_H */
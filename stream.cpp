@@ -0,0 +1,176 @@
+#include "stream.hpp"
+#include "parser.hpp"
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <float.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+StreamLoader::StreamLoader(const char *obj_file, const LoadOptions &opts)
+  : obj_file(obj_file), opts(opts), stop(false) {
+}
+
+StreamLoader::~StreamLoader() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stop = true;
+  }
+  not_full.notify_all();
+  if (worker.joinable()) worker.join();
+}
+
+void StreamLoader::start() {
+  worker = std::thread(&StreamLoader::run, this);
+}
+
+bool StreamLoader::pop(StreamChunk *chunk) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (queue.empty()) return false;
+  *chunk = std::move(queue.front());
+  queue.pop_front();
+  not_full.notify_one();
+  return true;
+}
+
+void StreamLoader::push(StreamChunk &chunk) {
+  std::unique_lock<std::mutex> lock(mutex);
+  not_full.wait(lock, [this] { return queue.size() < STREAM_QUEUE_SIZE || stop; });
+  if (stop) return;
+  queue.push_back(std::move(chunk));
+}
+
+void StreamLoader::fail(const std::string &error) {
+  StreamChunk chunk;
+  chunk.final = false;
+  chunk.has_texcoords = false;
+  chunk.error = error;
+  push(chunk);
+}
+
+void StreamLoader::run() {
+  int fd = open(obj_file.c_str(), O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    fail("stream: nao foi possivel abrir " + obj_file + ": " + strerror(errno));
+    if (fd >= 0) close(fd);
+    return;
+  }
+  void *data = st.st_size > 0 ? mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : nullptr;
+  close(fd);
+  if (data == MAP_FAILED) {
+    fail(std::string("stream: mmap falhou: ") + strerror(errno));
+    return;
+  }
+  madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+  const char *p = (const char *)data;
+  const char *end = p + st.st_size;
+
+  ObjData all;
+  std::vector<uint32_t> pending; // triangulos que usam vertices ainda nao lidos
+  size_t sent_verts = 0;
+  glm::vec3 bbox_min = glm::vec3(FLT_MAX);
+  glm::vec3 bbox_max = glm::vec3(-FLT_MAX);
+  uint32_t chan = 0;
+
+  StreamChunk chunk;
+  chunk.final = false;
+  chunk.has_texcoords = false;
+
+  while (p < end && !stop) {
+    const char *block_end = end;
+    if (end - p > STREAM_BLOCK_BYTES) {
+      const char *nl = (const char *)memchr(p + STREAM_BLOCK_BYTES, '\n', end - (p + STREAM_BLOCK_BYTES));
+      block_end = nl ? nl + 1 : end;
+    }
+
+    ObjData block;
+    ObjParser::parse_buffer(p, block_end, &block, all.vertices.size() / 3, all.normals.size() / 3, all.texcoords.size() / 2);
+    p = block_end;
+
+    size_t first_tri = all.indices.size() / 3;
+    all.vertices.insert(all.vertices.end(), block.vertices.begin(), block.vertices.end());
+    all.normals.insert(all.normals.end(), block.normals.begin(), block.normals.end());
+    all.texcoords.insert(all.texcoords.end(), block.texcoords.begin(), block.texcoords.end());
+    all.indices.insert(all.indices.end(), block.indices.begin(), block.indices.end());
+
+    // vertices novos da previa, um por posicao
+    size_t total_verts = all.vertices.size() / 3;
+    for (size_t v = sent_verts; v < total_verts; v++) {
+      glm::vec3 pos = glm::vec3(all.vertices[3*v+0], all.vertices[3*v+1], all.vertices[3*v+2]);
+      bbox_min = glm::min(bbox_min, pos);
+      bbox_max = glm::max(bbox_max, pos);
+    }
+    while (sent_verts < total_verts && !stop) {
+      size_t n = std::min<size_t>(STREAM_CHUNK_VERTS, total_verts - sent_verts);
+      chunk.vertices.resize(n);
+      for (size_t i = 0; i < n; i++) {
+	size_t v = sent_verts + i;
+	glm::vec4 color = glm::vec4(0.5f, 0.0f, .5f, 1.0f);
+	if (chan == 1) {
+	  color = glm::vec4(.2f, .5f, 0.0f, 1.0f);
+	} else if (chan == 2) {
+	  color = glm::vec4(0.0f, 0.2f, 1.0f, 1.0f);
+	}
+	chan = (chan + 1) % 3;
+	chunk.vertices[i] = (Vertex){ .position = glm::vec4(all.vertices[3*v+0], all.vertices[3*v+1], all.vertices[3*v+2], 1.0f), .normal = glm::vec3(0.0f), .color = color, .texcoord = glm::vec2(0.0f) };
+      }
+      chunk.bbox_min = bbox_min;
+      chunk.bbox_max = bbox_max;
+      sent_verts += n;
+      push(chunk);
+      chunk.vertices.clear();
+    }
+
+    // triangulos cujos vertices ja foram enviados
+    for (size_t t = first_tri; t < all.indices.size() / 3; t++) pending.push_back((uint32_t)t);
+    size_t kept = 0;
+    for (size_t i = 0; i < pending.size() && !stop; i++) {
+      const ObjIndex *tri = &all.indices[3 * (size_t)pending[i]];
+      bool ready = true;
+      for (int c = 0; c < 3; c++) ready = ready && tri[c].vertex_index >= 0 && (size_t)tri[c].vertex_index < sent_verts;
+      if (!ready) {
+	pending[kept++] = pending[i];
+	continue;
+      }
+      for (int c = 0; c < 3; c++) chunk.indices.push_back((uint32_t)tri[c].vertex_index);
+      if (chunk.indices.size() >= STREAM_CHUNK_INDICES) {
+	chunk.bbox_min = bbox_min;
+	chunk.bbox_max = bbox_max;
+	push(chunk);
+	chunk.indices.clear();
+      }
+    }
+    pending.resize(kept);
+    if (!chunk.indices.empty() && !stop) {
+      chunk.bbox_min = bbox_min;
+      chunk.bbox_max = bbox_max;
+      push(chunk);
+      chunk.indices.clear();
+    }
+  }
+  if (data) munmap(data, st.st_size);
+  if (stop) return;
+
+  // malha final com o pipeline completo (dedupe, normais, normalizacao)
+  MeshSettings m = ObjLoader::make_settings(obj_file.c_str(), nullptr);
+  if (!ObjLoader::build(all, opts, &m)) {
+    fail("stream: " + obj_file + " nao pode ser montado");
+    return;
+  }
+
+  StreamChunk final_chunk;
+  final_chunk.vertices.swap(m.vertices);
+  final_chunk.indices.swap(m.indices);
+  final_chunk.bbox_min = m.bbox_min;
+  final_chunk.bbox_max = m.bbox_max;
+  final_chunk.center = m.center;
+  final_chunk.lods.swap(m.lods);
+  final_chunk.meshlets.swap(m.meshlets);
+  final_chunk.has_texcoords = m.has_texcoords;
+  final_chunk.final = true;
+  push(final_chunk);
+}
@@ -0,0 +1,57 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include "mesh.hpp"
+#include "obj.hpp"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <atomic>
+#include <string>
+
+#define STREAM_BLOCK_BYTES (4 << 20)  // bytes do .obj lidos por vez
+#define STREAM_CHUNK_VERTS 65536      // vertices por pedaco enviado
+#define STREAM_CHUNK_INDICES (3 * 65536)
+#define STREAM_QUEUE_SIZE 16
+
+typedef struct {
+  std::vector<Vertex> vertices;  // anexados ao fim do VBO
+  std::vector<uint32_t> indices; // anexados ao fim do EBO
+  glm::vec3 bbox_min;            // caixa (sem normalizar) do que ja foi lido
+  glm::vec3 bbox_max;
+  bool final;                    // malha completa, substitui o que foi enviado ate aqui
+  glm::vec3 center;              // so no pedaco final, caixa ja normalizada
+  std::vector<MeshLod> lods;     // so no pedaco final, com --lod
+  std::vector<Meshlet> meshlets; // so no pedaco final, com --meshlets
+  bool has_texcoords;            // so no pedaco final, o .obj tem vt
+  std::string error;             // ultimo pedaco quando o loader falhou, o render sai do loop
+} StreamChunk;
+
+// le o .obj numa thread e entrega a geometria em pedacos de tamanho fixo,
+// o loop de render sobe os pedacos com glBufferSubData enquanto o parse continua
+class StreamLoader
+{
+public:
+  StreamLoader(const char *obj_file, const LoadOptions &opts);
+  ~StreamLoader();
+  void start();
+  // nao bloqueia, false se a fila esta vazia
+  bool pop(StreamChunk *chunk);
+
+private:
+  void run();
+  void push(StreamChunk &chunk);
+  // a thread nao sai do processo: entrega o erro ao render e termina
+  void fail(const std::string &error);
+
+  std::string obj_file;
+  LoadOptions opts;
+  std::thread worker;
+  std::mutex mutex;
+  std::condition_variable not_full;
+  std::deque<StreamChunk> queue;
+  std::atomic<bool> stop;
+};
+
+#endif /* STREAM_H */
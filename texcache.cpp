@@ -0,0 +1,270 @@
+#include "texcache.hpp"
+#include "cache.hpp"
+#include "bcn.hpp"
+#include "mesh.hpp"
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <functional>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <sys/stat.h>
+
+static const uint8_t ktx2_identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+typedef struct {
+  uint8_t identifier[12];
+  uint32_t vk_format;
+  uint32_t type_size;
+  uint32_t pixel_width;
+  uint32_t pixel_height;
+  uint32_t pixel_depth;
+  uint32_t layer_count;
+  uint32_t face_count;
+  uint32_t level_count;
+  uint32_t supercompression;
+  uint32_t dfd_offset;
+  uint32_t dfd_length;
+  uint32_t kvd_offset;
+  uint32_t kvd_length;
+  uint64_t sgd_offset;
+  uint64_t sgd_length;
+} Ktx2Header;
+
+// uma entrada por nivel, nivel 0 primeiro; os dados ficam do menor para o maior
+typedef struct {
+  uint64_t offset;
+  uint64_t length;
+  uint64_t uncompressed_length;
+} Ktx2Level;
+
+static_assert(sizeof(Ktx2Header) == 80, "Ktx2Header deve ter 80 bytes");
+static_assert(sizeof(Ktx2Level) == 24, "Ktx2Level deve ter 24 bytes");
+
+// VkFormat e modelo de cor do descritor (Khronos Data Format) de cada formato
+typedef struct {
+  int format;
+  uint32_t vk_format;
+  uint32_t color_model;
+} Ktx2Format;
+
+// os texels sao os do PNG (sRGB) com os mips filtrados em luz linear: VkFormat
+// _SRGB e transferencia sRGB no descritor, para as outras ferramentas KTX2
+#define KHR_DF_TRANSFER_SRGB 2
+
+static const Ktx2Format ktx2_formats[] = {
+  { TEX_FORMAT_BC1, 134, 128 }, // VK_FORMAT_BC1_RGBA_SRGB_BLOCK, KHR_DF_MODEL_BC1A
+  { TEX_FORMAT_BC3, 138, 130 }, // VK_FORMAT_BC3_SRGB_BLOCK, KHR_DF_MODEL_BC3
+  { TEX_FORMAT_BC7, 146, 134 }, // VK_FORMAT_BC7_SRGB_BLOCK, KHR_DF_MODEL_BC7
+};
+
+static const Ktx2Format *find_format(int format, uint32_t vk_format) {
+  for (size_t i = 0; i < sizeof(ktx2_formats) / sizeof(ktx2_formats[0]); i++) {
+    if (ktx2_formats[i].format == format || ktx2_formats[i].vk_format == vk_format) return &ktx2_formats[i];
+  }
+  return nullptr;
+}
+
+// bloco basico do descritor: blocos 4x4, BT.709 sRGB, uma amostra por metade de 64 bits
+static std::vector<uint32_t> data_format_descriptor(const Ktx2Format &f) {
+  uint32_t bytes = (uint32_t)BlockEncoder::block_bytes(f.format);
+  std::vector<uint32_t> samples; // bitOffset | bitLength - 1 | channelType
+  if (f.format == TEX_FORMAT_BC1) {
+    samples.push_back(0 | 63 << 16 | 1u << 24); // KHR_DF_CHANNEL_BC1A_ALPHAPRESENT
+  } else if (f.format == TEX_FORMAT_BC3) {
+    samples.push_back(0 | 63 << 16 | 15u << 24); // KHR_DF_CHANNEL_BC3_ALPHA
+    samples.push_back(64 | 63 << 16 | 0u << 24); // KHR_DF_CHANNEL_BC3_COLOR
+  } else {
+    samples.push_back(0 | 127 << 16 | 0u << 24); // KHR_DF_CHANNEL_BC7_COLOR
+  }
+  uint32_t block_size = 24 + 16 * (uint32_t)samples.size();
+  std::vector<uint32_t> dfd;
+  dfd.push_back(4 + block_size);
+  dfd.push_back(0);                             // vendor Khronos, descritor basico
+  dfd.push_back(2 | block_size << 16);          // versao 2
+  dfd.push_back(f.color_model | 1 << 8 | KHR_DF_TRANSFER_SRGB << 16); // BT.709, transferencia sRGB
+  dfd.push_back(3 | 3 << 8);                    // bloco 4x4x1x1
+  dfd.push_back(bytes);
+  dfd.push_back(0);
+  for (size_t s = 0; s < samples.size(); s++) {
+    dfd.push_back(samples[s]);
+    dfd.push_back(0);
+    dfd.push_back(0);
+    dfd.push_back(0xFFFFFFFFu);
+  }
+  return dfd;
+}
+
+static bool source_key(const char *tex_file, std::string *key) {
+  struct stat st;
+  if (stat(tex_file, &st) != 0) return false;
+  std::ostringstream out;
+  out << MeshCache::path_hash(tex_file) << " " << (uint64_t)st.st_size << " "
+      << (int64_t)st.st_mtim.tv_sec << " " << (int64_t)st.st_mtim.tv_nsec;
+  *key = out.str();
+  return true;
+}
+
+// floor(log2(max(w, h))) + 1: a cadeia de mips completa ate 1x1
+static uint32_t max_levels(uint32_t width, uint32_t height) {
+  uint32_t levels = 1;
+  for (uint32_t m = std::max(width, height); m > 1; m >>= 1) levels++;
+  return levels;
+}
+
+static void append_kv(std::vector<uint8_t> *kvd, const char *key, const std::string &value) {
+  uint32_t length = (uint32_t)(strlen(key) + 1 + value.size() + 1);
+  const uint8_t *p = (const uint8_t *)&length;
+  kvd->insert(kvd->end(), p, p + 4);
+  kvd->insert(kvd->end(), key, key + strlen(key) + 1);
+  kvd->insert(kvd->end(), value.c_str(), value.c_str() + value.size() + 1);
+  while (kvd->size() % 4) kvd->push_back(0);
+}
+
+static size_t align_to(size_t v, size_t a) {
+  return (v + a - 1) / a * a;
+}
+
+std::string TextureCache::cache_path(const char *tex_file) {
+  return std::string(tex_file) + TEX_CACHE_EXT;
+}
+
+bool TextureCache::write(const char *tex_file, const TextureImage &image) {
+  const Ktx2Format *f = find_format(image.format, 0);
+  std::string key;
+  if (f == nullptr || image.levels.empty()) return false;
+  if (!source_key(tex_file, &key)) {
+    std::cerr << "cache: nao foi possivel ler " << tex_file << ": " << strerror(errno) << std::endl;
+    return false;
+  }
+
+  uint32_t t_levels = (uint32_t)image.levels.size();
+  std::vector<uint32_t> dfd = data_format_descriptor(*f);
+  std::vector<uint8_t> kvd;
+  append_kv(&kvd, "KTXorientation", "ru"); // chaves em ordem
+  append_kv(&kvd, "KTXwriter", "mesh2");
+  append_kv(&kvd, TEX_CACHE_KEY, key);
+
+  Ktx2Header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.identifier, ktx2_identifier, sizeof(ktx2_identifier));
+  header.vk_format = f->vk_format;
+  header.type_size = 1;
+  header.pixel_width = image.levels[0].width;
+  header.pixel_height = image.levels[0].height;
+  header.face_count = 1;
+  header.level_count = t_levels;
+  header.dfd_offset = sizeof(Ktx2Header) + t_levels * sizeof(Ktx2Level);
+  header.dfd_length = dfd.size() * sizeof(uint32_t);
+  header.kvd_offset = header.dfd_offset + header.dfd_length;
+  header.kvd_length = kvd.size();
+
+  // niveis do menor para o maior, cada um alinhado ao tamanho do bloco
+  size_t align = BlockEncoder::block_bytes(image.format);
+  std::vector<Ktx2Level> index(t_levels);
+  size_t offset = header.kvd_offset + header.kvd_length;
+  for (int l = (int)t_levels - 1; l >= 0; l--) {
+    offset = align_to(offset, align);
+    index[l].offset = offset;
+    index[l].length = image.levels[l].size;
+    index[l].uncompressed_length = image.levels[l].size;
+    offset += image.levels[l].size;
+  }
+
+  // temporario por thread: contextos do --batch podem gravar a mesma textura juntos
+  std::string path = cache_path(tex_file);
+  std::ostringstream tmp;
+  tmp << path << ".tmp" << std::hash<std::thread::id>()(std::this_thread::get_id());
+  std::string tmp_path = tmp.str();
+  FILE *file = fopen(tmp_path.c_str(), "wb");
+  if (file == nullptr) {
+    std::cerr << "cache: nao foi possivel criar " << tmp_path << ": " << strerror(errno) << std::endl;
+    return false;
+  }
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+    && fwrite(index.data(), sizeof(Ktx2Level), t_levels, file) == t_levels
+    && fwrite(dfd.data(), sizeof(uint32_t), dfd.size(), file) == dfd.size()
+    && fwrite(kvd.data(), 1, kvd.size(), file) == kvd.size();
+  size_t written = header.kvd_offset + header.kvd_length;
+  const uint8_t zeros[16] = {};
+  for (int l = (int)t_levels - 1; ok && l >= 0; l--) {
+    ok = fwrite(zeros, 1, index[l].offset - written, file) == index[l].offset - written
+      && fwrite(&image.data[image.levels[l].offset], 1, index[l].length, file) == index[l].length;
+    written = index[l].offset + index[l].length;
+  }
+  ok = (fclose(file) == 0) && ok;
+  if (!ok || rename(tmp_path.c_str(), path.c_str()) != 0) {
+    std::cerr << "cache: erro escrevendo " << path << ": " << strerror(errno) << std::endl;
+    remove(tmp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool TextureCache::read(const char *tex_file, TextureImage *image) {
+  std::string path = cache_path(tex_file);
+  FILE *file = fopen(path.c_str(), "rb");
+  if (file == nullptr) return false;
+  std::vector<uint8_t> data;
+  struct stat st;
+  bool ok = fstat(fileno(file), &st) == 0 && (size_t)st.st_size >= sizeof(Ktx2Header);
+  if (ok) {
+    data.resize(st.st_size);
+    ok = fread(data.data(), 1, data.size(), file) == data.size();
+  }
+  fclose(file);
+  if (!ok) return false;
+
+  Ktx2Header header;
+  memcpy(&header, data.data(), sizeof(header));
+  const Ktx2Format *f = find_format(-1, header.vk_format);
+  uint64_t index_end = sizeof(Ktx2Header) + (uint64_t)header.level_count * sizeof(Ktx2Level);
+  bool valid = memcmp(header.identifier, ktx2_identifier, sizeof(ktx2_identifier)) == 0
+    && f != nullptr
+    && header.pixel_width > 0 && header.pixel_height > 0 && header.pixel_depth == 0
+    && header.layer_count == 0 && header.face_count == 1 && header.supercompression == 0
+    && header.level_count > 0 && header.level_count <= max_levels(header.pixel_width, header.pixel_height)
+    && index_end <= data.size()
+    && (uint64_t)header.kvd_offset + header.kvd_length <= data.size()
+    && header.dfd_length >= 16 && (uint64_t)header.dfd_offset + header.dfd_length <= data.size();
+
+  // cache antigo gravado como linear: refaz com a transferencia certa
+  uint32_t model = 0;
+  if (valid) memcpy(&model, &data[header.dfd_offset + 12], 4);
+  valid = valid && (model >> 16 & 0xFF) == KHR_DF_TRANSFER_SRGB;
+
+  // chave da fonte nos pares chave/valor
+  std::string key, cached_key;
+  for (uint32_t pos = header.kvd_offset; valid && pos + 4 <= header.kvd_offset + header.kvd_length; ) {
+    uint32_t length;
+    memcpy(&length, &data[pos], 4);
+    if (length > header.kvd_offset + header.kvd_length - pos - 4) break;
+    const char *entry = (const char *)&data[pos + 4];
+    size_t key_len = strnlen(entry, length);
+    if (key_len < length && strcmp(entry, TEX_CACHE_KEY) == 0) cached_key.assign(entry + key_len + 1, strnlen(entry + key_len + 1, length - key_len - 1));
+    pos += 4 + (uint32_t)align_to(length, 4);
+  }
+  valid = valid && source_key(tex_file, &key) && key == cached_key;
+
+  std::vector<TextureLevel> levels(valid ? header.level_count : 0);
+  for (uint32_t l = 0; valid && l < header.level_count; l++) {
+    Ktx2Level entry;
+    memcpy(&entry, &data[sizeof(Ktx2Header) + l * sizeof(Ktx2Level)], sizeof(entry));
+    int w = std::max(1u, header.pixel_width >> l);
+    int h = std::max(1u, header.pixel_height >> l);
+    valid = entry.length == BlockEncoder::level_size(f->format, w, h) && entry.offset + entry.length <= data.size();
+    levels[l] = (TextureLevel){ .width = w, .height = h, .offset = (size_t)entry.offset, .size = (size_t)entry.length };
+  }
+  if (!valid) {
+    std::cout << "cache: " << path << " desatualizado, ignorando." << std::endl;
+    return false;
+  }
+
+  image->format = f->format;
+  image->channels = 4;
+  image->levels.swap(levels);
+  image->data.swap(data); // os niveis apontam para dentro do arquivo
+  return true;
+}
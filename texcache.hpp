@@ -0,0 +1,38 @@
+#ifndef TEXCACHE_H
+#define TEXCACHE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#define TEX_CACHE_EXT ".ktx2"
+#define TEX_CACHE_KEY "mesh2.source" // chave do KTX2 com caminho, tamanho e mtime da fonte
+
+typedef struct {
+  int width;
+  int height;
+  size_t offset; // em TextureImage::data
+  size_t size;
+} TextureLevel;
+
+// textura com a cadeia de mips inteira, nivel 0 primeiro
+typedef struct {
+  int format;   // TEXTURE_FORMAT, nunca TEX_FORMAT_AUTO
+  int channels; // do arquivo, so com TEX_FORMAT_NONE
+  std::vector<TextureLevel> levels;
+  std::vector<uint8_t> data;
+} TextureImage;
+
+// cache KTX2 ao lado da textura (BC1/BC3/BC7 com a cadeia de mips), invalidado
+// como o .mesh2cache quando o caminho, o tamanho ou o mtime da fonte mudam
+class TextureCache
+{
+public:
+  static std::string cache_path(const char *tex_file);
+  static bool write(const char *tex_file, const TextureImage &image);
+  // so formatos comprimidos; false se nao existe, esta desatualizado ou invalido
+  static bool read(const char *tex_file, TextureImage *image);
+};
+
+#endif /* TEXCACHE_H */
@@ -0,0 +1,118 @@
+#include "texgen.hpp"
+#include "parallel.hpp"
+#include <cmath>
+#include <unordered_map>
+
+glm::vec2 TexcoordGenerator::project(TEXTURE_MODE mode, glm::vec3 pos) {
+  switch (mode) {
+  case ORTHO:
+    return glm::vec2(pos.x + 0.5f, pos.y + 0.5f); // -0.5 .. 0.5
+  case CIL: {
+    float u = ((float)M_PI + atan2f(pos.z, pos.x)) / (2.0f * (float)M_PI);
+    return glm::vec2(u, 0.5f + 0.5f * pos.y);
+  }
+  case SPH: {
+    float u = ((float)M_PI + atan2f(pos.z, pos.x)) / (2.0f * (float)M_PI);
+    float len = glm::length(pos);
+    float v = len > 0.0f ? acosf(std::max(-1.0f, std::min(1.0f, pos.y / len))) / (float)M_PI : 0.5f;
+    return glm::vec2(u, v);
+  }
+  default:
+    return glm::vec2(pos.x, pos.y);
+  }
+}
+
+void TexcoordGenerator::generate(TEXTURE_MODE mode, const Vertex *verts, uint64_t t_verts, const uint32_t *indices, uint64_t t_index,
+				 const std::vector<IndexRange> &ranges, uint64_t max_verts, TexcoordStream *out) {
+  out->uvs.resize(t_verts);
+  out->seam_verts.clear();
+  out->indices.clear();
+  out->skipped = 0;
+
+  parallel_for(t_verts, TEXGEN_GRAIN, [&](size_t begin, size_t end, uint32_t) {
+    for (size_t i = begin; i < end; i++) {
+      out->uvs[i] = mode == UV ? verts[i].texcoord : TexcoordGenerator::project(mode, glm::vec3(verts[i].position));
+    }
+  });
+  if (mode != CIL && mode != SPH) return;
+
+  // vertice no eixo y: o atan nao tem direcao, o u vem dos outros cantos do triangulo
+  auto is_pole = [&](uint32_t v) {
+    return fabsf(verts[v].position.x) < TEXGEN_POLE_EPS && fabsf(verts[v].position.z) < TEXGEN_POLE_EPS;
+  };
+
+  // triangulos que dao a volta no u (a interpolacao passaria por toda a textura) ou tocam o polo
+  for (const IndexRange &range : ranges) {
+    uint64_t t_tris = range.t_index / 3;
+    std::vector<std::vector<uint32_t>> found(parallel_workers(t_tris, TEXGEN_GRAIN));
+    parallel_for(t_tris, TEXGEN_GRAIN, [&](size_t begin, size_t end, uint32_t worker) {
+      for (size_t t = begin; t < end; t++) {
+	const uint32_t *tri = &indices[range.first_index + 3 * t];
+	float u_min = 1.0f, u_max = 0.0f;
+	bool pole = false;
+	for (int c = 0; c < 3; c++) {
+	  uint32_t v = tri[c] + (uint32_t)range.base_vertex;
+	  if (is_pole(v)) {
+	    pole = true;
+	    continue;
+	  }
+	  u_min = std::min(u_min, out->uvs[v].x);
+	  u_max = std::max(u_max, out->uvs[v].x);
+	}
+	if (pole || u_max - u_min > 0.5f) found[worker].push_back((uint32_t)t);
+      }
+    });
+
+    // as copias da costura sao compartilhadas (inclusive pelas LODs), as do polo sao uma por triangulo
+    std::unordered_map<uint32_t, uint32_t> copy_of;
+    for (const std::vector<uint32_t> &seams : found) {
+      for (uint32_t t : seams) {
+	if (out->indices.empty()) out->indices.assign(indices, indices + t_index);
+	uint32_t *tri = &out->indices[range.first_index + 3 * t];
+	uint32_t v[3];
+	bool pole[3];
+	float u_min = 1.0f, u_max = 0.0f;
+	for (int c = 0; c < 3; c++) {
+	  v[c] = tri[c] + (uint32_t)range.base_vertex;
+	  pole[c] = is_pole(v[c]);
+	  if (pole[c]) continue;
+	  u_min = std::min(u_min, out->uvs[v[c]].x);
+	  u_max = std::max(u_max, out->uvs[v[c]].x);
+	}
+	bool wrap = u_max - u_min > 0.5f;
+	auto wraps = [&](int c) { return !pole[c] && wrap && out->uvs[v[c]].x < 0.5f; };
+
+	uint64_t needed = 0;
+	for (int c = 0; c < 3; c++) needed += pole[c] || (wraps(c) && copy_of.find(v[c]) == copy_of.end());
+	if (out->uvs.size() + needed > max_verts) {
+	  out->skipped++;
+	  continue;
+	}
+
+	float u_sum = 0.0f;
+	int t_sides = 0;
+	for (int c = 0; c < 3; c++) {
+	  if (pole[c]) continue;
+	  if (wraps(c)) {
+	    auto it = copy_of.find(v[c]);
+	    if (it == copy_of.end()) {
+	      it = copy_of.emplace(v[c], (uint32_t)out->uvs.size()).first;
+	      out->seam_verts.push_back(v[c]);
+	      out->uvs.push_back(glm::vec2(out->uvs[v[c]].x + 1.0f, out->uvs[v[c]].y));
+	    }
+	    tri[c] = it->second - (uint32_t)range.base_vertex;
+	  }
+	  u_sum += out->uvs[tri[c] + range.base_vertex].x;
+	  t_sides++;
+	}
+	for (int c = 0; c < 3; c++) {
+	  if (!pole[c]) continue;
+	  float u = t_sides > 0 ? u_sum / t_sides : out->uvs[v[c]].x;
+	  tri[c] = (uint32_t)(out->uvs.size() - range.base_vertex);
+	  out->seam_verts.push_back(v[c]);
+	  out->uvs.push_back(glm::vec2(u, out->uvs[v[c]].y));
+	}
+      }
+    }
+  }
+}
@@ -0,0 +1,35 @@
+#ifndef TEXGEN_H
+#define TEXGEN_H
+
+#include "mesh.hpp"
+
+#define TEXGEN_GRAIN 16384    // vertices/triangulos minimos por thread
+#define TEXGEN_POLE_EPS 1e-6f // |x| e |z| abaixo disso: vertice no eixo das projecoes CIL/SPH
+
+// faixa do EBO com indices relativos a base_vertex (uma por parte da cena)
+typedef struct {
+  uint64_t first_index;
+  uint64_t t_index;
+  uint64_t base_vertex;
+} IndexRange;
+
+// uv por vertice do modo ativo, com as copias dos vertices da costura no fim
+typedef struct {
+  std::vector<glm::vec2> uvs;       // t_verts + seam_verts.size()
+  std::vector<uint32_t> seam_verts; // vertice original de cada copia (costura e polo), a partir de t_verts
+  std::vector<uint32_t> indices;    // EBO com os triangulos da costura nas copias, vazio sem costura
+  uint64_t skipped;                 // triangulos sem copia por falta de indices (16 bits)
+} TexcoordStream;
+
+// projecoes ORTHO/CIL/SPH na CPU, no lugar do atan/acos por fragmento
+class TexcoordGenerator
+{
+public:
+  static glm::vec2 project(TEXTURE_MODE mode, glm::vec3 pos);
+  // UV copia o vt do arquivo; CIL e SPH duplicam os vertices com u < 0.5 dos
+  // triangulos que cruzam o atan (u + 1, com GL_REPEAT) e os do polo, ate max_verts vertices
+  static void generate(TEXTURE_MODE mode, const Vertex *verts, uint64_t t_verts, const uint32_t *indices, uint64_t t_index,
+		       const std::vector<IndexRange> &ranges, uint64_t max_verts, TexcoordStream *out);
+};
+
+#endif /* TEXGEN_H */
@@ -0,0 +1,472 @@
+#include "texture.hpp"
+#include "bcn.hpp"
+#include "mesh.hpp"
+#include "parallel.hpp"
+#define STB_IMAGE_IMPLEMENTATION // aqui e nao no main.cpp: o mesh2-bench tambem decodifica com --convert
+#include "stb_image.h"
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <GL/glew.h>
+
+static const char *format_names[] = { "auto", "none", "bc1", "bc3", "bc7" };
+static const GLenum formats[] = { GL_RED, GL_RG, GL_RGB, GL_RGBA };
+static const GLint internal_formats[] = { GL_R8, GL_RG8, GL_RGB8, GL_RGBA8 };
+
+static GLenum compressed_format(int format) {
+  if (format == TEX_FORMAT_BC1) return GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+  if (format == TEX_FORMAT_BC3) return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+  return GL_COMPRESSED_RGBA_BPTC_UNORM_ARB;
+}
+
+// media dos mips em luz linear: a media dos valores sRGB escurece as bordas
+static float srgb_linear[256];
+static uint8_t linear_srgb[4096];
+
+static bool srgb_tables() {
+  for (int i = 0; i < 256; i++) {
+    float c = i / 255.0f;
+    srgb_linear[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+  }
+  for (int i = 0; i < 4096; i++) {
+    float l = i / 4095.0f;
+    float c = l <= 0.0031308f ? l * 12.92f : 1.055f * powf(l, 1.0f / 2.4f) - 0.055f;
+    linear_srgb[i] = (uint8_t)lrintf(c * 255.0f);
+  }
+  return true;
+}
+
+// uma vez so, mesmo com a TextureLoader e a TextureArray em threads diferentes
+static void init_srgb() {
+  static bool tables = srgb_tables();
+  (void)tables;
+}
+
+// 2x2 texels por texel; na borda impar repete a ultima linha/coluna. Cor em luz
+// linear, alfa (o ultimo canal com 2 ou 4 canais) direto
+static void downsample(const uint8_t *src, int sw, int sh, int channels, uint8_t *dst, int dw, int dh) {
+  init_srgb();
+  int alpha = channels == 2 || channels == 4 ? channels - 1 : -1;
+  for (int y = 0; y < dh; y++) {
+    int y0 = std::min(2 * y, sh - 1), y1 = std::min(2 * y + 1, sh - 1);
+    for (int x = 0; x < dw; x++) {
+      int x0 = std::min(2 * x, sw - 1), x1 = std::min(2 * x + 1, sw - 1);
+      const uint8_t *p[4] = { &src[(y0 * sw + x0) * channels], &src[(y0 * sw + x1) * channels],
+			      &src[(y1 * sw + x0) * channels], &src[(y1 * sw + x1) * channels] };
+      for (int c = 0; c < channels; c++) {
+	if (c == alpha) {
+	  dst[(y * dw + x) * channels + c] = (uint8_t)((p[0][c] + p[1][c] + p[2][c] + p[3][c] + 2) / 4);
+	} else {
+	  float l = (srgb_linear[p[0][c]] + srgb_linear[p[1][c]] + srgb_linear[p[2][c]] + srgb_linear[p[3][c]]) / 4.0f;
+	  dst[(y * dw + x) * channels + c] = linear_srgb[(int)lrintf(l * 4095.0f)];
+	}
+      }
+    }
+  }
+}
+
+// stb_image com os canais do arquivo e a cadeia completa ate 1x1, todos os niveis num vetor so
+static bool decode(const char *tex_file, TextureImage *image) {
+  // a flag global do stb nao serve com outras threads decodificando
+  stbi_set_flip_vertically_on_load_thread(1);
+  int width, height, channels;
+  uint8_t *data = stbi_load(tex_file, &width, &height, &channels, 0);
+  if (data == nullptr) {
+    std::cerr << "ERROR: Failed to load texture " << tex_file << ": " << stbi_failure_reason() << std::endl;
+    return false;
+  }
+
+  image->format = TEX_FORMAT_NONE;
+  image->channels = channels;
+  image->levels.clear();
+  size_t total = 0;
+  for (int w = width, h = height; ; w = std::max(1, w / 2), h = std::max(1, h / 2)) {
+    size_t size = (size_t)w * h * channels;
+    image->levels.push_back((TextureLevel){ .width = w, .height = h, .offset = total, .size = size });
+    total += size;
+    if (w == 1 && h == 1) break;
+  }
+  image->data.resize(total);
+  memcpy(image->data.data(), data, (size_t)width * height * channels);
+  stbi_image_free(data);
+  for (size_t l = 1; l < image->levels.size(); l++) {
+    const TextureLevel &src = image->levels[l - 1];
+    const TextureLevel &dst = image->levels[l];
+    downsample(&image->data[src.offset], src.width, src.height, channels, &image->data[dst.offset], dst.width, dst.height);
+  }
+  return true;
+}
+
+// bilinear RGBA para o tamanho comum do --texarray, cor em luz linear como no downsample
+static void resize(const uint8_t *src, int sw, int sh, uint8_t *dst, int dw, int dh) {
+  init_srgb();
+  for (int y = 0; y < dh; y++) {
+    float fy = std::max(0.0f, (y + 0.5f) * sh / dh - 0.5f);
+    int y0 = std::min((int)fy, sh - 1), y1 = std::min(y0 + 1, sh - 1);
+    float ty = fy - y0;
+    for (int x = 0; x < dw; x++) {
+      float fx = std::max(0.0f, (x + 0.5f) * sw / dw - 0.5f);
+      int x0 = std::min((int)fx, sw - 1), x1 = std::min(x0 + 1, sw - 1);
+      float tx = fx - x0;
+      const uint8_t *p[4] = { &src[(y0 * sw + x0) * 4], &src[(y0 * sw + x1) * 4],
+			      &src[(y1 * sw + x0) * 4], &src[(y1 * sw + x1) * 4] };
+      float w[4] = { (1.0f - tx) * (1.0f - ty), tx * (1.0f - ty), (1.0f - tx) * ty, tx * ty };
+      uint8_t *q = &dst[(y * dw + x) * 4];
+      for (int c = 0; c < 3; c++) {
+	float l = w[0] * srgb_linear[p[0][c]] + w[1] * srgb_linear[p[1][c]] + w[2] * srgb_linear[p[2][c]] + w[3] * srgb_linear[p[3][c]];
+	q[c] = linear_srgb[std::min(4095, (int)lrintf(l * 4095.0f))];
+      }
+      q[3] = (uint8_t)std::min(255, (int)lrintf(w[0] * p[0][3] + w[1] * p[1][3] + w[2] * p[2][3] + w[3] * p[3][3]));
+    }
+  }
+}
+
+static bool opaque(const TextureImage &image) {
+  if (image.channels == 1 || image.channels == 3) return true;
+  const TextureLevel &l = image.levels[0];
+  for (size_t i = 0; i < (size_t)l.width * l.height; i++) {
+    if (image.data[l.offset + i * image.channels + image.channels - 1] != 255) return false;
+  }
+  return true;
+}
+
+// cada nivel expandido para RGBA e comprimido
+static void compress(int format, TextureImage *image) {
+  std::vector<uint8_t> out;
+  std::vector<uint8_t> rgba;
+  std::vector<TextureLevel> levels;
+  int channels = image->channels;
+  for (size_t l = 0; l < image->levels.size(); l++) {
+    const TextureLevel &src = image->levels[l];
+    size_t texels = (size_t)src.width * src.height;
+    rgba.resize(texels * 4);
+    for (size_t i = 0; i < texels; i++) {
+      const uint8_t *p = &image->data[src.offset + i * channels];
+      uint8_t *q = &rgba[4 * i];
+      q[0] = p[0];
+      q[1] = channels >= 3 ? p[1] : p[0];
+      q[2] = channels >= 3 ? p[2] : p[0];
+      q[3] = channels == 2 || channels == 4 ? p[channels - 1] : 255;
+    }
+    size_t size = BlockEncoder::level_size(format, src.width, src.height);
+    levels.push_back((TextureLevel){ .width = src.width, .height = src.height, .offset = out.size(), .size = size });
+    out.resize(out.size() + size);
+    BlockEncoder::encode(format, rgba.data(), src.width, src.height, &out[levels.back().offset]);
+  }
+  image->format = format;
+  image->channels = 4;
+  image->levels.swap(levels);
+  image->data.swap(out);
+}
+
+TextureLoader::TextureLoader(const char *tex_file, int format, bool use_cache)
+  : tex_file(tex_file), format(format), use_cache(use_cache), supported(TextureLoader::supported_formats()),
+    ready(false), failed(false), level(-1), row(0), next(0), pbo_size(0) {
+  for (int i = 0; i < TEXTURE_PBO_RING; i++) {
+    pbos[i] = 0;
+    fences[i] = nullptr;
+  }
+}
+
+TextureLoader::~TextureLoader() {
+  if (worker.joinable()) worker.join();
+  for (int i = 0; i < TEXTURE_PBO_RING; i++) {
+    if (fences[i] != nullptr) glDeleteSync(fences[i]);
+  }
+  if (pbos[0] != 0) glDeleteBuffers(TEXTURE_PBO_RING, pbos);
+}
+
+void TextureLoader::placeholder(uint32_t tex) {
+  const uint8_t gray[4] = { 128, 128, 128, 255 };
+  glBindTexture(GL_TEXTURE_2D, tex);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, gray);
+}
+
+uint32_t TextureLoader::supported_formats() {
+  uint32_t bits = 0;
+  GLint count = 0;
+  glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+  for (GLint i = 0; i < count; i++) {
+    const char *ext = (const char *)glGetStringi(GL_EXTENSIONS, i);
+    if (strcmp(ext, "GL_EXT_texture_compression_s3tc") == 0) bits |= 1u << TEX_FORMAT_BC1 | 1u << TEX_FORMAT_BC3;
+    if (strcmp(ext, "GL_ARB_texture_compression_bptc") == 0) bits |= 1u << TEX_FORMAT_BC7;
+  }
+  return bits;
+}
+
+bool TextureLoader::prepare(const char *tex_file, int format, uint32_t supported, bool use_cache, TextureImage *image) {
+  clock::time_point start = clock::now();
+  if (format >= TEX_FORMAT_BC1 && !(supported & 1u << format)) {
+    std::cout << "textura: " << format_names[format] << " sem suporte no driver, sem compressao" << std::endl;
+    format = TEX_FORMAT_NONE;
+  }
+
+  bool cached = false;
+  if (format != TEX_FORMAT_NONE && use_cache && TextureCache::read(tex_file, image)) {
+    cached = format == TEX_FORMAT_AUTO ? (supported & 1u << image->format) != 0 : image->format == format;
+  }
+  if (!cached) {
+    if (!decode(tex_file, image)) return false;
+    if (format == TEX_FORMAT_AUTO) {
+      // opaca vai em BC1 (8x menor que RGBA8), com alfa em BC7 (4x)
+      bool s3tc = (supported & 1u << TEX_FORMAT_BC1) != 0;
+      bool bptc = (supported & 1u << TEX_FORMAT_BC7) != 0;
+      if (opaque(*image)) format = s3tc ? TEX_FORMAT_BC1 : bptc ? TEX_FORMAT_BC7 : TEX_FORMAT_NONE;
+      else format = bptc ? TEX_FORMAT_BC7 : s3tc ? TEX_FORMAT_BC3 : TEX_FORMAT_NONE;
+    }
+    if (format != TEX_FORMAT_NONE) {
+      compress(format, image);
+      if (use_cache && TextureCache::write(tex_file, *image)) {
+	std::cout << "cache escrito: " << TextureCache::cache_path(tex_file) << std::endl;
+      }
+    }
+  }
+
+  const TextureLevel &base = image->levels[0];
+  size_t bytes = 0, rgba = 0;
+  for (size_t l = 0; l < image->levels.size(); l++) {
+    bytes += image->levels[l].size;
+    rgba += (size_t)image->levels[l].width * image->levels[l].height * 4;
+  }
+  std::cout << "textura: " << tex_file << (cached ? " (cache) " : " ") << format_names[image->format] << " "
+	    << base.width << "x" << base.height << ", " << image->levels.size() << " niveis, " << bytes / 1024
+	    << " KB (rgba8: " << rgba / 1024 << " KB), " << std::chrono::duration<double, std::milli>(clock::now() - start).count()
+	    << " ms" << std::endl;
+  return true;
+}
+
+void TextureLoader::start() {
+  start_time = clock::now();
+  worker = std::thread(&TextureLoader::run, this);
+}
+
+void TextureLoader::run() {
+  failed = !TextureLoader::prepare(tex_file.c_str(), format, supported, use_cache, &image);
+  ready = true;
+}
+
+// aloca o nivel atual; os maiores continuam fora por GL_TEXTURE_BASE_LEVEL
+void TextureLoader::begin_level() {
+  const TextureLevel &l = image.levels[level];
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0); // com um PBO ligado o NULL seria um offset
+  if (image.format != TEX_FORMAT_NONE) {
+    glTexImage2D(GL_TEXTURE_2D, level, compressed_format(image.format), l.width, l.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+  } else {
+    glTexImage2D(GL_TEXTURE_2D, level, internal_formats[image.channels - 1], l.width, l.height, 0,
+		 formats[image.channels - 1], GL_UNSIGNED_BYTE, NULL);
+  }
+  row = 0;
+}
+
+bool TextureLoader::upload(uint32_t tex, bool wait) {
+  if (!ready) return false;
+  if (failed) {
+    // o placeholder ja ligado fica como a textura
+    if (worker.joinable()) worker.join();
+    std::cerr << "textura: " << tex_file << " falhou, fica o placeholder" << std::endl;
+    return true;
+  }
+  glBindTexture(GL_TEXTURE_2D, tex);
+
+  // sem compressao uma linha de blocos e uma linha de texels
+  bool compressed = image.format != TEX_FORMAT_NONE;
+  int block = compressed ? BC_BLOCK_DIM : 1;
+  size_t block_bytes = compressed ? BlockEncoder::block_bytes(image.format) : image.channels;
+
+  if (pbo_size == 0) {
+    if (worker.joinable()) worker.join();
+    // tons de cinza (com ou sem alfa) replicados nos tres canais
+    int channels = image.channels;
+    GLint gray[] = { GL_RED, GL_RED, GL_RED, channels == 2 ? GL_GREEN : GL_ONE };
+    GLint color[] = { GL_RED, GL_GREEN, GL_BLUE, channels == 4 ? GL_ALPHA : GL_ONE };
+    glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, channels <= 2 ? gray : color);
+
+    size_t row_bytes = (image.levels[0].width + block - 1) / block * block_bytes;
+    pbo_size = std::max<size_t>(TEXTURE_UPLOAD_BYTES, row_bytes);
+    glGenBuffers(TEXTURE_PBO_RING, pbos);
+    for (int i = 0; i < TEXTURE_PBO_RING; i++) {
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbos[i]);
+      glBufferData(GL_PIXEL_UNPACK_BUFFER, pbo_size, NULL, GL_STREAM_DRAW);
+    }
+    level = (int)image.levels.size() - 1;
+    begin_level();
+  }
+
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  size_t budget = TEXTURE_UPLOAD_BYTES;
+  while (level >= 0 && (budget > 0 || wait)) {
+    // o PBO da vez so volta a ser escrito depois que a GPU leu a copia anterior
+    TextureFence &fence = fences[next];
+    if (fence != nullptr) {
+      GLenum status = glClientWaitSync(fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? GL_TIMEOUT_IGNORED : 0);
+      if (status == GL_TIMEOUT_EXPIRED) break;
+      glDeleteSync(fence);
+      fence = nullptr;
+    }
+
+    const TextureLevel &l = image.levels[level];
+    size_t row_bytes = (l.width + block - 1) / block * block_bytes;
+    int t_rows = (l.height + block - 1) / block;
+    size_t limit = wait ? pbo_size : std::min(budget, pbo_size);
+    int rows = std::min(t_rows - row, std::max(1, (int)(limit / row_bytes)));
+    size_t size = (size_t)rows * row_bytes;
+    int y = row * block;
+    int height = std::min(rows * block, l.height - y);
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbos[next]);
+    void *dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size,
+				 GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    memcpy(dst, &image.data[l.offset + (size_t)row * row_bytes], size);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    if (compressed) {
+      glCompressedTexSubImage2D(GL_TEXTURE_2D, level, 0, y, l.width, height, compressed_format(image.format), size, (void*)0);
+    } else {
+      glTexSubImage2D(GL_TEXTURE_2D, level, 0, y, l.width, height, formats[image.channels - 1], GL_UNSIGNED_BYTE, (void*)0);
+    }
+    fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    next = (next + 1) % TEXTURE_PBO_RING;
+    budget -= std::min(budget, size);
+
+    row += rows;
+    if (row == t_rows) {
+      // nivel inteiro: passa a ser o mais nitido amostrado
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (int)image.levels.size() - 1);
+      level--;
+      if (level >= 0) begin_level();
+    }
+  }
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+  if (level >= 0) return false;
+  std::cout << "textura completa: " << std::chrono::duration<double, std::milli>(clock::now() - start_time).count()
+	    << " ms" << std::endl;
+  image = TextureImage();
+  return true;
+}
+
+void TextureLoader::finish(uint32_t tex) {
+  if (worker.joinable()) worker.join();
+  upload(tex, true);
+}
+
+TextureArray::TextureArray(const std::vector<const char *> &tex_files, int max_size)
+  : tex_files(tex_files.begin(), tex_files.end()), max_size(max_size), ready(false), failed(false) {
+}
+
+TextureArray::~TextureArray() {
+  if (worker.joinable()) worker.join();
+}
+
+void TextureArray::placeholder(uint32_t tex) {
+  const uint8_t gray[4] = { 128, 128, 128, 255 };
+  glBindTexture(GL_TEXTURE_2D_ARRAY, tex);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, 0);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
+  glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, 1, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, gray);
+}
+
+void TextureArray::start() {
+  start_time = clock::now();
+  worker = std::thread(&TextureArray::run, this);
+}
+
+void TextureArray::run() {
+  // o tamanho comum sai do cabecalho, sem esperar decode nenhum
+  size_t t_layers = tex_files.size();
+  int width = 1, height = 1;
+  for (size_t i = 0; i < t_layers; i++) {
+    int w, h, channels;
+    if (!stbi_info(tex_files[i].c_str(), &w, &h, &channels)) {
+      std::cerr << "ERROR: Failed to load texture " << tex_files[i] << ": " << stbi_failure_reason() << std::endl;
+      failed = true;
+      ready = true;
+      return;
+    }
+    width = std::max(width, w);
+    height = std::max(height, h);
+  }
+  width = std::min(width, max_size);
+  height = std::min(height, max_size);
+
+  image.format = TEX_FORMAT_NONE;
+  image.channels = 4;
+  image.levels.clear();
+  size_t total = 0;
+  for (int w = width, h = height; ; w = std::max(1, w / 2), h = std::max(1, h / 2)) {
+    size_t size = (size_t)w * h * 4 * t_layers;
+    image.levels.push_back((TextureLevel){ .width = w, .height = h, .offset = total, .size = size });
+    total += size;
+    if (w == 1 && h == 1) break;
+  }
+  image.data.resize(total);
+
+  // uma camada por vez em cada thread: decode, tamanho comum e mips
+  parallel_for(t_layers, 1, [&](size_t begin, size_t end, uint32_t) {
+    stbi_set_flip_vertically_on_load_thread(1);
+    for (size_t i = begin; i < end; i++) {
+      int w, h, channels;
+      uint8_t *data = stbi_load(tex_files[i].c_str(), &w, &h, &channels, 4);
+      if (data == nullptr) {
+	std::cerr << "ERROR: Failed to load texture " << tex_files[i] << ": " << stbi_failure_reason() << std::endl;
+	failed = true;
+	continue;
+      }
+      const TextureLevel &base = image.levels[0];
+      uint8_t *dst = &image.data[base.offset + i * (base.size / t_layers)];
+      if (w == width && h == height) memcpy(dst, data, base.size / t_layers);
+      else resize(data, w, h, dst, width, height);
+      stbi_image_free(data);
+      for (size_t l = 1; l < image.levels.size(); l++) {
+	const TextureLevel &src = image.levels[l - 1];
+	const TextureLevel &lvl = image.levels[l];
+	downsample(&image.data[src.offset + i * (src.size / t_layers)], src.width, src.height, 4,
+		   &image.data[lvl.offset + i * (lvl.size / t_layers)], lvl.width, lvl.height);
+      }
+    }
+  });
+
+  std::cout << "texturas: " << t_layers << " camadas " << width << "x" << height << ", " << image.levels.size()
+	    << " niveis, " << total / 1024 << " KB, " << std::chrono::duration<double, std::milli>(clock::now() - start_time).count()
+	    << " ms" << std::endl;
+  ready = true;
+}
+
+bool TextureArray::upload(uint32_t tex) {
+  if (!ready) return false;
+  if (worker.joinable()) worker.join();
+  if (failed) {
+    // a camada cinza do placeholder fica no lugar de todas
+    std::cerr << "texturas: alguma camada falhou, fica o placeholder" << std::endl;
+    image = TextureImage();
+    return true;
+  }
+  glBindTexture(GL_TEXTURE_2D_ARRAY, tex);
+  for (size_t l = 0; l < image.levels.size(); l++) {
+    const TextureLevel &lvl = image.levels[l];
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, (int)l, GL_RGBA8, lvl.width, lvl.height, (int)tex_files.size(), 0,
+		 GL_RGBA, GL_UNSIGNED_BYTE, &image.data[lvl.offset]);
+  }
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, (int)image.levels.size() - 1);
+  std::cout << "texturas completas: " << std::chrono::duration<double, std::milli>(clock::now() - start_time).count()
+	    << " ms" << std::endl;
+  image = TextureImage();
+  return true;
+}
+
+void TextureArray::finish(uint32_t tex) {
+  if (worker.joinable()) worker.join();
+  upload(tex);
+}
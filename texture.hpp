@@ -0,0 +1,95 @@
+#ifndef TEXTURE_H
+#define TEXTURE_H
+
+#include "texcache.hpp"
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+#define TEXTURE_PBO_RING 3            // pixel unpack buffers em voo
+#define TEXTURE_UPLOAD_BYTES (1 << 20) // bytes enviados por frame, no maximo
+#define TEXTURE_ARRAY_MAX_SIZE 2048    // lado maximo das camadas do --texarray
+
+typedef struct __GLsync *TextureFence; // GLsync sem puxar o glew para o header
+
+// decodifica a textura numa thread (com o numero real de canais), gera os mips
+// na CPU e comprime em BC1/BC3/BC7 com o cache .ktx2, que nas proximas execucoes
+// pula o PNG. O render sobe os niveis do menor para o maior por um anel de PBOs,
+// ate TEXTURE_UPLOAD_BYTES por frame, e a textura vai ficando mais nitida
+class TextureLoader
+{
+public:
+  // format: TEXTURE_FORMAT pedido; precisa do contexto GL atual para ver o que o driver aceita
+  TextureLoader(const char *tex_file, int format, bool use_cache);
+  ~TextureLoader();
+  // textura cinza 1x1 ate o primeiro nivel chegar, filtros e wrap finais
+  static void placeholder(uint32_t tex);
+  // bits (1 << TEXTURE_FORMAT) dos formatos comprimidos que o contexto atual aceita
+  static uint32_t supported_formats();
+  // cache valido ou decode, mips e compressao (gravando o cache); sem GL.
+  // false se o arquivo nao decodifica (o erro ja foi impresso)
+  static bool prepare(const char *tex_file, int format, uint32_t supported, bool use_cache, TextureImage *image);
+  void start();
+  // no render, liga tex em GL_TEXTURE_2D: true quando todos os niveis subiram
+  // (ou o decode falhou e o placeholder fica). Com wait espera o decode e os
+  // PBOs em vez de deixar para o proximo frame
+  bool upload(uint32_t tex, bool wait);
+  // --headless e --batch: um frame so, sobe tudo antes dele
+  void finish(uint32_t tex);
+
+private:
+  typedef std::chrono::steady_clock clock;
+  void run();
+  void begin_level();
+
+  std::string tex_file;
+  int format;
+  bool use_cache;
+  uint32_t supported;
+  std::thread worker;
+  std::atomic<bool> ready;
+  bool failed; // escrito antes do ready, a thread nao sai do processo
+  clock::time_point start_time;
+  TextureImage image;
+  int level; // nivel sendo enviado, -1 no fim
+  int row;   // proxima linha de blocos (de texels sem compressao) do nivel
+  uint32_t pbos[TEXTURE_PBO_RING];
+  TextureFence fences[TEXTURE_PBO_RING];
+  uint32_t next;
+  size_t pbo_size;
+};
+
+// --texarray: decodifica as texturas em paralelo numa thread, leva todas para o
+// tamanho da maior (bilinear) e gera os mips; o render sobe tudo de uma vez num
+// GL_TEXTURE_2D_ARRAY e trocar de textura e so trocar o uniform da camada
+class TextureArray
+{
+public:
+  TextureArray(const std::vector<const char *> &tex_files, int max_size);
+  ~TextureArray();
+  // uma camada cinza 1x1 ate as texturas chegarem
+  static void placeholder(uint32_t tex);
+  void start();
+  // no render, liga tex em GL_TEXTURE_2D_ARRAY: true quando as camadas subiram
+  bool upload(uint32_t tex);
+  // --headless e --batch: espera o decode e sobe antes do frame
+  void finish(uint32_t tex);
+
+private:
+  typedef std::chrono::steady_clock clock;
+  void run();
+
+  std::vector<std::string> tex_files;
+  int max_size;
+  std::thread worker;
+  std::atomic<bool> ready;
+  std::atomic<bool> failed; // alguma camada nao decodificou, fica o placeholder
+  clock::time_point start_time;
+  TextureImage image; // cada nivel com todas as camadas, uma depois da outra
+};
+
+#endif /* TEXTURE_H */